@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Compare clean build times with and without --longest-first.
+#
+# usage: bench-longest-first.sh [-r RUNS] [-j JOBS] [-n NGEN]
+#
+# The project in the current directory is built once into bench-build to
+# get a .ninja_log, then clean RUNS times in each mode, with JOBS jobs (the
+# number of cores by default):
+#
+#   manifest    as generated, in sources order
+#   size        --longest-first with no log, so by file size
+#   history     --longest-first with the first build's .ninja_log
+#
+set -e
+
+runs=3
+jobs=$(getconf _NPROCESSORS_ONLN 2>/dev/null || nproc)
+ngen=ngen
+
+while getopts r:j:n: opt; do
+    case $opt in
+        r) runs=$OPTARG ;;
+        j) jobs=$OPTARG ;;
+        n) ngen=$OPTARG ;;
+        *) echo "usage: $0 [-r RUNS] [-j JOBS] [-n NGEN]" >&2; exit 64 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -ne 0 ]; then
+    echo "usage: $0 [-r RUNS] [-j JOBS] [-n NGEN]" >&2
+    exit 64
+fi
+
+now() {
+    date +%s.%N
+}
+
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+rm -rf bench-build bench-dist
+$ngen -B bench-build -D bench-dist >/dev/null
+ninja -j "$jobs" >/dev/null
+cp bench-build/.ninja_log "$log"
+
+printf '%-10s %6s %12s %12s %12s\n' mode jobs mean_s min_s max_s
+
+for mode in manifest size history; do
+    flags=
+    [ $mode != manifest ] && flags=--longest-first
+
+    times=
+    i=0
+    while [ $i -lt $runs ]; do
+        rm -rf bench-build bench-dist
+        mkdir bench-build
+        [ $mode = history ] && cp "$log" bench-build/.ninja_log
+        $ngen -B bench-build -D bench-dist $flags >/dev/null
+
+        start=$(now)
+        ninja -j "$jobs" >/dev/null
+        end=$(now)
+        times="$times $start $end"
+        i=$((i + 1))
+    done
+
+    # mean, min, max
+    set -- $(echo $times | awk '{
+        for (i = 1; i < NF; i += 2) {
+            took = $(i + 1) - $i
+            total += took
+            if (i == 1 || took < min) min = took
+            if (i == 1 || took > max) max = took
+        }
+        printf "%.3f %.3f %.3f\n", total / (NF / 2), min, max
+    }')
+
+    printf '%-10s %6s %12s %12s %12s\n' $mode $jobs $1 $2 $3
+done
@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Compare build time and run time of the gcc backend's LTO modes.
+#
+# usage: bench-lto.sh [-r RUNS] [-n NGEN] COMMAND [ARGS...]
+#
+# Each mode gets a clean build-MODE and dist-MODE in the current directory,
+# then COMMAND is timed RUNS times with DISTDIR set to dist-MODE. E.g.
+#
+#   bench-lto.sh -r 5 sh -c '$DISTDIR/bin/myapp --benchmark'
+#
+set -e
+
+runs=3
+ngen=ngen
+
+while getopts r:n: opt; do
+    case $opt in
+        r) runs=$OPTARG ;;
+        n) ngen=$OPTARG ;;
+        *) echo "usage: $0 [-r RUNS] [-n NGEN] COMMAND [ARGS...]" >&2; exit 64 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+    echo "usage: $0 [-r RUNS] [-n NGEN] COMMAND [ARGS...]" >&2
+    exit 64
+fi
+
+now() {
+    date +%s.%N
+}
+
+printf '%-12s %12s %12s %12s\n' mode build_s run_s size_bytes
+
+for mode in none full partitioned; do
+    rm -rf build-$mode dist-$mode
+    $ngen --lto $mode -B build-$mode -D dist-$mode >/dev/null
+
+    start=$(now)
+    ninja >/dev/null
+    end=$(now)
+    build=$(echo "$end - $start" | bc)
+
+    total=0
+    i=0
+    while [ $i -lt $runs ]; do
+        start=$(now)
+        DISTDIR=dist-$mode "$@" >/dev/null
+        end=$(now)
+        total=$(echo "$total + $end - $start" | bc)
+        i=$((i + 1))
+    done
+    run=$(echo "scale=3; $total / $runs" | bc)
+
+    size=$(find dist-$mode -type f -exec cat {} + | wc -c)
+
+    printf '%-12s %12s %12s %12s\n' $mode $build $run $size
+done
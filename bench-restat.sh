@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Count the links --restat-objects saves over a replay of a project's history.
+#
+# usage: bench-restat.sh [-n NGEN] REPO FIRST LAST
+#
+# REPO is cloned into restat-MODE in the current directory for each mode,
+# built at FIRST, then at every commit up to LAST in turn. The compiles and
+# links each mode ran after FIRST are counted from ninja's output.
+#
+set -e
+
+ngen=ngen
+
+while getopts n: opt; do
+    case $opt in
+        n) ngen=$OPTARG ;;
+        *) echo "usage: $0 [-n NGEN] REPO FIRST LAST" >&2; exit 64 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -ne 3 ]; then
+    echo "usage: $0 [-n NGEN] REPO FIRST LAST" >&2
+    exit 64
+fi
+
+repo=$1
+first=$2
+last=$3
+
+# ngen may be relative to here, and the builds happen in the clones.
+case $ngen in
+    */*) ngen=$(cd "$(dirname "$ngen")" && pwd)/$(basename "$ngen") ;;
+esac
+
+build() {
+    $ngen $1 >/dev/null
+    NINJA_STATUS='[ninja] ' ninja > ninja.out
+    compiles=$((compiles + $(grep -cE '^\[ninja\] (CC|CXX) ' ninja.out || true)))
+    links=$((links + $(grep -c '^\[ninja\] LD ' ninja.out || true)))
+}
+
+printf '%-10s %8s %10s %8s\n' mode commits compiles links
+
+for mode in plain restat; do
+    flags=
+    [ $mode = restat ] && flags=--restat-objects
+
+    rm -rf restat-$mode
+    git clone -q "$repo" restat-$mode
+    (
+        cd restat-$mode
+        git checkout -q "$first"
+        compiles=0
+        links=0
+        build "$flags"
+
+        compiles=0
+        links=0
+        commits=0
+        for commit in $(git rev-list --reverse "$first..$last"); do
+            git checkout -q "$commit"
+            build "$flags"
+            commits=$((commits + 1))
+        done
+
+        printf '%-10s %8s %10s %8s\n' $mode $commits $compiles $links
+    )
+done
@@ -39,8 +39,28 @@ cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\util.obj /c
 @IF errorlevel 1 goto :eof
 cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\external.obj /c src\external.cpp
 @IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\Manifest.obj /c src\Manifest.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\blast.obj /c src\blast.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\NinjaLog.obj /c src\NinjaLog.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\analyze.obj /c src\analyze.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\modules.obj /c src\modules.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\objectcache.obj /c src\objectcache.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\artifactcache.obj /c src\artifactcache.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\distribute.obj /c src\distribute.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\usage.obj /c src\usage.cpp
+@IF errorlevel 1 goto :eof
+cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fo%BOOTSTRAPDIR%\install.obj /c src\install.cpp
+@IF errorlevel 1 goto :eof
 
-@SET NGEN_OBJ=%BOOTSTRAPDIR%\main.obj %BOOTSTRAPDIR%\Statement.obj %BOOTSTRAPDIR%\Shinobi.obj %BOOTSTRAPDIR%\cxxbase.obj %BOOTSTRAPDIR%\msvc.obj %BOOTSTRAPDIR%\gcc.obj %BOOTSTRAPDIR%\javac.obj %BOOTSTRAPDIR%\package.obj %BOOTSTRAPDIR%\path.obj %BOOTSTRAPDIR%\util.obj %BOOTSTRAPDIR%\external.obj
+@SET NGEN_OBJ=%BOOTSTRAPDIR%\main.obj %BOOTSTRAPDIR%\Statement.obj %BOOTSTRAPDIR%\Shinobi.obj %BOOTSTRAPDIR%\cxxbase.obj %BOOTSTRAPDIR%\msvc.obj %BOOTSTRAPDIR%\gcc.obj %BOOTSTRAPDIR%\javac.obj %BOOTSTRAPDIR%\package.obj %BOOTSTRAPDIR%\path.obj %BOOTSTRAPDIR%\util.obj %BOOTSTRAPDIR%\external.obj %BOOTSTRAPDIR%\Manifest.obj %BOOTSTRAPDIR%\blast.obj %BOOTSTRAPDIR%\NinjaLog.obj %BOOTSTRAPDIR%\analyze.obj %BOOTSTRAPDIR%\modules.obj %BOOTSTRAPDIR%\objectcache.obj %BOOTSTRAPDIR%\artifactcache.obj %BOOTSTRAPDIR%\distribute.obj %BOOTSTRAPDIR%\usage.obj %BOOTSTRAPDIR%\install.obj
 
 cl /nologo %NGEN_FLAGS% /Fd%BOOTSTRAPDIR%\ngen.pdb /Fe%BOOTSTRAPDIR%\ngen %NGEN_OBJ%
 @IF errorlevel 1 goto :eof
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Build a package as N shards on this machine, then merge them into distdir.
+#
+# usage: run-shards.sh [-n NGEN] [-j JOBS] N [NGEN_ARGS...]
+#
+# Each shard's ninja runs at once, with JOBS jobs each, the way N builders
+# would. They hand artifacts to each other through the artifact cache, then
+# build.ninja assembles distdir. Prints how long each shard took.
+#
+set -e
+
+ngen=ngen
+jobs=
+
+while getopts n:j: opt; do
+    case $opt in
+        n) ngen=$OPTARG ;;
+        j) jobs="-j $OPTARG" ;;
+        *) echo "usage: $0 [-n NGEN] [-j JOBS] N [NGEN_ARGS...]" >&2; exit 64 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 [-n NGEN] [-j JOBS] N [NGEN_ARGS...]" >&2
+    exit 64
+fi
+
+shards=$1
+shift
+
+$ngen --shards $shards "$@" >/dev/null
+
+pids=
+shard=0
+while [ $shard -lt $shards ]; do
+    (
+        start=$(date +%s)
+        ninja $jobs -f shard-$shard.ninja >shard-$shard.log 2>&1 || { echo "shard $shard failed, see shard-$shard.log" >&2; exit 1; }
+        echo "shard $shard: $(( $(date +%s) - start )) s"
+    ) &
+    pids="$pids $!"
+    shard=$((shard + 1))
+done
+
+failed=0
+for pid in $pids; do
+    wait $pid || failed=1
+done
+[ $failed -eq 0 ]
+
+ninja $jobs
@@ -17,7 +17,13 @@
  */
 
 
+#include "NinjaLog.hpp"
 #include "Shinobi.hpp"
+#include "usage.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <vector>
@@ -87,6 +93,159 @@ struct Bundle
     /** Ye who generates.
      */
     Shinobi::unique_ptr generator;
+
+    /** Report what regenerating will invalidate.
+     */
+    bool blastRadius;
+
+    /** Fail if more than this many edges are invalidated; < 0 for no limit.
+     */
+    long blastRadiusMax;
+
+    /** Where to save/load command hashes between runs.
+     *
+     * When empty, the previous output is read instead.
+     */
+    std::string commandHashesPath;
+
+    /** Write build graph analytics after generating.
+     */
+    bool analyzeGraph;
+
+    /** Analytics are written to graphPrefix.json and graphPrefix.dot.
+     */
+    std::string graphPrefix;
+
+    /** A .ninja_log to take edge durations from.
+     *
+     * When empty, the one in builddir is used by those that need it.
+     */
+    std::string ninjaLogPath;
+
+    /** Analyze the last build in the .ninja_log after generating.
+     */
+    bool analyzeLog;
+
+    /** How many of the slowest edges analyzeLog reports.
+     */
+    size_t analyzeLogTop;
+
+    /** Where analyzeLog writes a Chrome trace of the build.
+     */
+    std::string tracePath;
+
+    /** Emit the longest edges first, so ninja starts them first.
+     */
+    bool longestFirst;
+
+    /** Durations from a previous build, if there is one.
+     *
+     * Shared by the children of a package.
+     */
+    std::shared_ptr<NinjaLog> history;
+
+    /** Record the peak memory and CPU time of every compile.
+     */
+    bool recordUsage;
+
+    /** Where recordUsage writes to, and usage is read from.
+     */
+    std::string usagePath;
+
+    /** Peak memory of compiles in a previous build, if there is one.
+     *
+     * Shared by the children of a package.
+     */
+    std::shared_ptr<UsageLog> usage;
+
+    /** Command compiles are run through, e.g. ccache.
+     */
+    std::string launcher;
+
+    /** Overrides /project/lto for every project when not empty.
+     */
+    std::string lto;
+
+    /** Overrides /project/linker for every project when not empty.
+     *
+     * A comma separated list, in order of preference.
+     */
+    std::string linker;
+
+    /** Links and archives with more inputs than this use a response file.
+     *
+     * < 0 for never.
+     */
+    long responseFileThreshold;
+
+    /** False for the children of a package.
+     */
+    bool toplevel;
+
+    /** How build.ninja runs ngen again, e.g. to collate modules.
+     */
+    std::string self;
+
+    /** Install headers and install_files with one process per project,
+     * rather than one per file.
+     */
+    bool bulkInstall;
+
+    /** Overrides /project/restat_objects for every project when true.
+     */
+    bool restatObjects;
+
+    /** Directory of the object cache to compile through, or empty for none.
+     */
+    std::string objectCache;
+
+    /** Bytes the object cache is trimmed to.
+     */
+    uintmax_t objectCacheSize;
+
+    /** How many shards to split a package into, or 0 to build it whole.
+     */
+    long shards;
+
+    /** Seconds a shard waits for another to publish what it needs.
+     */
+    long shardTimeout;
+
+    /** Hosts to compile on, as given to --distribute, or empty for none.
+     */
+    std::string distribute;
+
+    /** Directory of the artifact cache for package children, or empty for none.
+     */
+    std::string artifactCache;
+
+    /** The artifact cache key of each package child, by project name.
+     *
+     * Dependents fold these into their own keys.
+     */
+    std::shared_ptr<std::map<std::string, std::string>> artifactKeys;
+
+    /** What dependents link with for each library made so far, by targetName.
+     *
+     * Paths are in the library's builddir, so dependents can link as soon as
+     * it has, rather than after it's installed. Shared by a package's
+     * children.
+     */
+    std::shared_ptr<std::map<std::string, std::string>> artifacts;
+
+    /** Targets only built when asked for by name, e.g. launcher-stats.
+     *
+     * Shared by a package's children, so the top level's default leaves
+     * theirs out too.
+     */
+    std::shared_ptr<std::set<std::string>> onRequest;
+
+    /** How each library exporting a precompiled header compiles it, by
+     * targetName, so those using it can tell if the compiler will.
+     *
+     * Shared by a package's children.
+     */
+    std::shared_ptr<std::map<std::string, std::string>> precompiledHeaders;
 };
 
 #endif // NGEN_BUNDLE__HPP
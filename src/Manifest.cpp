@@ -0,0 +1,510 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Manifest.hpp"
+
+#include "path.hpp"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+using std::endl;
+using string = Manifest::string;
+using list = Manifest::list;
+using Lookup = std::function<string(const string&)>;
+
+static bool isVarChar(char c, bool braced)
+{
+    return (c >= 'a' && c <= 'z')
+        || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9')
+        || c == '_' || c == '-'
+        || (braced && c == '.');
+}
+
+
+/*
+ * Expand $var, ${var}, and the $$, $ , $: escapes in text.
+ */
+static string expand(const string& text, const Lookup& lookup)
+{
+    string r;
+
+    for (size_t i=0; i < text.size(); ++i) {
+        char c = text[i];
+
+        if (c != '$' || i + 1 >= text.size()) {
+            r.push_back(c);
+            continue;
+        }
+
+        char n = text[++i];
+
+        if (n == '$' || n == ' ' || n == ':') {
+            r.push_back(n);
+        } else if (n == '{') {
+            size_t end = text.find('}', i);
+            if (end == string::npos)
+                end = text.size();
+            r.append(lookup(text.substr(i + 1, end - i - 1)));
+            i = end;
+        } else if (isVarChar(n, false)) {
+            size_t end = i;
+            while (end < text.size() && isVarChar(text[end], false))
+                ++end;
+            r.append(lookup(text.substr(i, end - i)));
+            i = end - 1;
+        } else {
+            r.push_back(n);
+        }
+    }
+
+    return r;
+}
+
+
+/*
+ * Split the unexpanded path list of a build line into tokens. The ":", "|"
+ * and "||" separators are returned as their own tokens.
+ */
+static list tokenize(const string& text)
+{
+    list tokens;
+    string cur;
+
+    auto flush = [&]() {
+        if (!cur.empty())
+            tokens.push_back(cur);
+        cur.clear();
+    };
+
+    for (size_t i=0; i < text.size(); ++i) {
+        char c = text[i];
+
+        if (c == '$' && i + 1 < text.size()) {
+            cur.push_back(c);
+            cur.push_back(text[++i]);
+        } else if (c == ' ' || c == '\t') {
+            flush();
+        } else if (c == ':') {
+            flush();
+            tokens.push_back(":");
+        } else if (c == '|') {
+            flush();
+            if (i + 1 < text.size() && text[i + 1] == '|') {
+                tokens.push_back("||");
+                ++i;
+            } else {
+                tokens.push_back("|");
+            }
+        } else {
+            cur.push_back(c);
+        }
+    }
+    flush();
+
+    return tokens;
+}
+
+
+static string ltrim(const string& s)
+{
+    size_t b = s.find_first_not_of(" \t");
+    return b == string::npos ? "" : s.substr(b);
+}
+
+
+static string rtrim(const string& s)
+{
+    size_t e = s.find_last_not_of(" \t\r");
+    return e == string::npos ? "" : s.substr(0, e + 1);
+}
+
+
+/*
+ * Read path into logical lines, joining $-newline continuations and
+ * dropping comments and blank lines.
+ */
+static bool readLines(const string& path, list& lines)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    string line;
+    string logical;
+    bool continued = false;
+
+    while (std::getline(in, line)) {
+        line = rtrim(line);
+
+        if (continued)
+            line = ltrim(line);
+        else if (ltrim(line).empty() || ltrim(line)[0] == '#')
+            continue;
+
+        size_t dollars = 0;
+        while (dollars < line.size() && line[line.size() - 1 - dollars] == '$')
+            ++dollars;
+
+        if (dollars % 2 == 1) {
+            logical.append(line, 0, line.size() - 1);
+            continued = true;
+            continue;
+        }
+
+        logical.append(line);
+        lines.push_back(logical);
+        logical.clear();
+        continued = false;
+    }
+
+    if (!logical.empty())
+        lines.push_back(logical);
+
+    return true;
+}
+
+
+static bool isIndented(const string& line)
+{
+    return !line.empty() && (line[0] == ' ' || line[0] == '\t');
+}
+
+
+/*
+ * Splits "key = value" into its parts. Value is left unexpanded.
+ */
+static bool binding(const string& line, string& key, string& value)
+{
+    size_t eq = line.find('=');
+    if (eq == string::npos)
+        return false;
+
+    key = rtrim(ltrim(line.substr(0, eq)));
+    value = ltrim(line.substr(eq + 1));
+
+    return !key.empty();
+}
+
+
+static string join(const list& words, char sep)
+{
+    string r;
+
+    for (const string& word : words) {
+        if (!r.empty())
+            r.push_back(sep);
+        r.append(word);
+    }
+
+    return r;
+}
+
+
+string Manifest::Scope::lookup(const string& name) const
+{
+    for (const Scope* s = this; s != nullptr; s = s->parent) {
+        auto it = s->variables.find(name);
+        if (it != s->variables.cend())
+            return it->second;
+    }
+
+    return "";
+}
+
+
+const Manifest::Rule* Manifest::Scope::rule(const string& name) const
+{
+    for (const Scope* s = this; s != nullptr; s = s->parent) {
+        auto it = s->rules.find(name);
+        if (it != s->rules.cend())
+            return &it->second;
+    }
+
+    return nullptr;
+}
+
+
+Manifest::Manifest()
+    : mScopes()
+    , mEdges()
+    , mProducers()
+    , mConsumers()
+    , mOrderOnlyConsumers()
+{
+}
+
+
+bool Manifest::load(const string& path)
+{
+    mScopes.clear();
+    mEdges.clear();
+    mProducers.clear();
+    mConsumers.clear();
+    mOrderOnlyConsumers.clear();
+
+    mScopes.push_back(Scope{ nullptr, path, {}, {} });
+
+    if (!parse(path, mScopes.back()))
+        return false;
+
+    for (size_t i=0; i < mEdges.size(); ++i) {
+        const Edge& edge = mEdges[i];
+
+        for (const string& out : edge.outputs)
+            mProducers[out] = i;
+        for (const string& out : edge.implicitOutputs)
+            mProducers[out] = i;
+        for (const string& in : edge.inputs)
+            mConsumers[in].push_back(i);
+        for (const string& in : edge.implicitDependencies)
+            mConsumers[in].push_back(i);
+        for (const string& in : edge.orderOnlyDependencies)
+            mOrderOnlyConsumers[in].push_back(i);
+    }
+
+    return true;
+}
+
+
+bool Manifest::parse(const string& path, Scope& scope)
+{
+    list lines;
+
+    if (!readLines(path, lines)) {
+        std::clog << "cannot open manifest: " << path << endl;
+        return false;
+    }
+
+    Lookup fileLookup = [&scope](const string& name) { return scope.lookup(name); };
+
+    for (size_t i=0; i < lines.size(); ++i) {
+        const string& line = lines[i];
+        string key, value;
+
+        if (isIndented(line)) {
+            std::clog << path << ": unexpected indent: " << line << endl;
+            return false;
+        }
+
+        string word = line.substr(0, line.find(' '));
+        string rest = ltrim(line.substr(word.size()));
+
+        if (word == "rule") {
+            Rule rule{ rtrim(rest), {} };
+
+            while (i + 1 < lines.size() && isIndented(lines[i + 1])) {
+                if (binding(lines[++i], key, value))
+                    rule.bindings[key] = value;
+            }
+
+            scope.rules[rule.name] = rule;
+        } else if (word == "build") {
+            Edge edge;
+            edge.scope = &scope;
+
+            while (i + 1 < lines.size() && isIndented(lines[i + 1])) {
+                if (binding(lines[++i], key, value))
+                    edge.variables[key] = expand(value, fileLookup);
+            }
+
+            Lookup edgeLookup = [&edge, &scope](const string& name) {
+                auto it = edge.variables.find(name);
+                if (it != edge.variables.cend())
+                    return it->second;
+                return scope.lookup(name);
+            };
+
+            /*
+             * outputs | implicit outputs : rule inputs | implicit || order-only
+             */
+            list* into = &edge.outputs;
+            bool wantRule = false;
+
+            for (const string& token : tokenize(rest)) {
+                if (token == ":") {
+                    wantRule = true;
+                    into = &edge.inputs;
+                } else if (wantRule) {
+                    edge.rule = token;
+                    wantRule = false;
+                } else if (token == "|") {
+                    into = (into == &edge.outputs) ? &edge.implicitOutputs : &edge.implicitDependencies;
+                } else if (token == "||") {
+                    into = &edge.orderOnlyDependencies;
+                } else {
+                    into->push_back(lexically_normal(expand(token, edgeLookup)));
+                }
+            }
+
+            if (edge.rule.empty()) {
+                std::clog << path << ": build statement without a rule: " << line << endl;
+                return false;
+            }
+
+            mEdges.push_back(edge);
+        } else if (word == "pool") {
+            while (i + 1 < lines.size() && isIndented(lines[i + 1]))
+                ++i;
+        } else if (word == "default") {
+            continue;
+        } else if (word == "include") {
+            if (!parse(expand(rest, fileLookup), scope))
+                return false;
+        } else if (word == "subninja") {
+            string child = expand(rest, fileLookup);
+
+            mScopes.push_back(Scope{ &scope, child, {}, {} });
+            if (!parse(child, mScopes.back()))
+                return false;
+        } else if (binding(line, key, value)) {
+            scope.variables[key] = expand(value, fileLookup);
+        } else {
+            std::clog << path << ": cannot parse: " << line << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+const std::vector<Manifest::Edge>& Manifest::edges() const
+{
+    return mEdges;
+}
+
+
+Manifest::list Manifest::files() const
+{
+    list r;
+
+    for (const Scope& scope : mScopes)
+        r.push_back(scope.file);
+
+    return r;
+}
+
+
+Manifest::string Manifest::variable(const Edge& edge, const string& name) const
+{
+    if (name == "in")
+        return join(edge.inputs, ' ');
+    if (name == "in_newline")
+        return join(edge.inputs, '\n');
+    if (name == "out")
+        return join(edge.outputs, ' ');
+
+    auto it = edge.variables.find(name);
+    if (it != edge.variables.cend())
+        return it->second;
+
+    const Rule* rule = edge.scope->rule(edge.rule);
+    if (rule != nullptr) {
+        auto bound = rule->bindings.find(name);
+        if (bound != rule->bindings.cend()) {
+            return expand(bound->second, [this, &edge](const string& n) {
+                return variable(edge, n);
+            });
+        }
+    }
+
+    return edge.scope->lookup(name);
+}
+
+
+Manifest::string Manifest::command(const Edge& edge) const
+{
+    return variable(edge, "command");
+}
+
+
+Manifest::string Manifest::project(const Edge& edge) const
+{
+    string name = edge.scope->lookup("targetName");
+
+    if (name.empty())
+        name = edge.scope->lookup("sourcedir");
+
+    return name;
+}
+
+
+const Manifest::Edge* Manifest::producer(const string& output) const
+{
+    auto it = mProducers.find(output);
+
+    if (it == mProducers.cend())
+        return nullptr;
+
+    return &mEdges[it->second];
+}
+
+
+std::vector<const Manifest::Edge*> Manifest::consumers(const string& output, bool orderOnly) const
+{
+    std::vector<const Edge*> r;
+
+    auto it = mConsumers.find(output);
+    if (it != mConsumers.cend()) {
+        for (size_t i : it->second)
+            r.push_back(&mEdges[i]);
+    }
+
+    if (orderOnly) {
+        it = mOrderOnlyConsumers.find(output);
+        if (it != mOrderOnlyConsumers.cend()) {
+            for (size_t i : it->second)
+                r.push_back(&mEdges[i]);
+        }
+    }
+
+    return r;
+}
+
+
+size_t Manifest::index(const Edge& edge) const
+{
+    return static_cast<size_t>(&edge - mEdges.data());
+}
+
+
+Manifest::string Manifest::kind(const string& rule)
+{
+    auto endsWith = [&rule](const string& suffix) {
+        return rule.size() >= suffix.size()
+            && rule.compare(rule.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    if (endsWith("_compile") || endsWith("_compile_restat"))
+        return "compile";
+    if (endsWith("_application") || endsWith("_library")
+        || endsWith("_application_rsp") || endsWith("_library_rsp"))
+    {
+        return "link";
+    }
+    if (rule == "install" || rule == "copy" || rule.find("install_") == 0)
+        return "install";
+    if (rule == "exec" || rule == "make")
+        return "exec";
+    if (rule == "cmake" || rule == "ninja")
+        return "cmake";
+
+    return rule;
+}
@@ -0,0 +1,138 @@
+#ifndef NGEN_MANIFEST__HPP
+#define NGEN_MANIFEST__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Reader for generated build.ninja files.
+ *
+ * Understands enough of the ninja syntax to load a build.ninja and its
+ * subninja/include files, then expand variables the way ninja would. Pools
+ * and default statements are skipped over, since nothing here needs them.
+ */
+class Manifest
+{
+  public:
+    using string = std::string;
+    using list = std::vector<string>;
+    using Bindings = std::map<string, string>;
+
+    /** A rule block. Bindings are kept unexpanded.
+     */
+    struct Rule
+    {
+        string name;
+        Bindings bindings;
+    };
+
+    /** Variables and rules for a file.
+     *
+     * Each subninja gets a new scope that can see its parent's.
+     */
+    struct Scope
+    {
+        const Scope* parent;
+        string file;
+        Bindings variables;
+        std::map<string, Rule> rules;
+
+        string lookup(const string& name) const;
+        const Rule* rule(const string& name) const;
+    };
+
+    /** A build statement.
+     *
+     * Paths are already expanded and passed through lexically_normal(), so
+     * they match what ninja reports.
+     */
+    struct Edge
+    {
+        string rule;
+        list outputs;
+        list implicitOutputs;
+        list inputs;
+        list implicitDependencies;
+        list orderOnlyDependencies;
+        Bindings variables;
+        const Scope* scope;
+    };
+
+    Manifest();
+
+    /** Load path, and any files it includes.
+     *
+     * @returns false on failure, with a message on std::clog.
+     */
+    bool load(const string& path);
+
+    const std::vector<Edge>& edges() const;
+
+    /** Returns all the files that were loaded, in order.
+     */
+    list files() const;
+
+    /** Returns the expanded value of name as seen by edge.
+     */
+    string variable(const Edge& edge, const string& name) const;
+
+    /** Returns variable(edge, "command").
+     */
+    string command(const Edge& edge) const;
+
+    /** Returns the ngen project an edge belongs to.
+     *
+     * This is the targetName of the file it came from, or its sourcedir if
+     * that is empty.
+     */
+    string project(const Edge& edge) const;
+
+    /** Returns the edge that builds output, or nullptr.
+     */
+    const Edge* producer(const string& output) const;
+
+    /** Returns the edges that use output as an input or dependency.
+     *
+     * @param orderOnly include order-only (||) dependencies.
+     */
+    std::vector<const Edge*> consumers(const string& output, bool orderOnly) const;
+
+    /** Returns the index of edge in edges().
+     */
+    size_t index(const Edge& edge) const;
+
+    /** Returns a kind of edge for the rule.
+     *
+     * One of compile, link, install, exec, cmake, phony, or the rule name if
+     * it is not one ngen generates.
+     */
+    static string kind(const string& rule);
+
+  private:
+
+    bool parse(const string& path, Scope& scope);
+
+    std::deque<Scope> mScopes;
+    std::vector<Edge> mEdges;
+    std::map<string, size_t> mProducers;
+    std::map<string, std::vector<size_t>> mConsumers;
+    std::map<string, std::vector<size_t>> mOrderOnlyConsumers;
+};
+
+#endif // NGEN_MANIFEST__HPP
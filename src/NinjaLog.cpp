@@ -0,0 +1,179 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NinjaLog.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using std::endl;
+using std::string;
+
+
+/*
+ * Like std::stol, but false for anything that isn't all number instead of
+ * throwing. Logs get cut short when ninja is killed.
+ */
+static bool parseLong(const string& text, long& value)
+{
+    char* end = nullptr;
+
+    errno = 0;
+    value = std::strtol(text.c_str(), &end, 10);
+
+    return !text.empty() && errno == 0 && *end == '\0';
+}
+
+NinjaLog::NinjaLog()
+    : mLastBuild()
+    , mLatest()
+{
+}
+
+
+bool NinjaLog::load(const string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::clog << "cannot open ninja log: " << path << endl;
+        return false;
+    }
+
+    string line;
+    if (!std::getline(in, line) || line.find("# ninja log v") != 0) {
+        std::clog << path << ": not a ninja log" << endl;
+        return false;
+    }
+
+    long version = 0;
+    if (!parseLong(line.substr(13), version)) {
+        std::clog << path << ": not a ninja log" << endl;
+        return false;
+    }
+    if (version < 5) {
+        std::clog << path << ": ninja log v" << version << " is too old, need v5 or later" << endl;
+        return false;
+    }
+
+    mLastBuild.clear();
+    mLatest.clear();
+
+    long lastEnd = 0;
+
+    /*
+     * start end mtime output hash, tab separated.
+     */
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        string start, end, mtime;
+        Entry entry;
+
+        if (!std::getline(fields, start, '\t')
+            || !std::getline(fields, end, '\t')
+            || !std::getline(fields, mtime, '\t')
+            || !std::getline(fields, entry.output, '\t'))
+        {
+            continue;
+        }
+        std::getline(fields, entry.hash);
+
+        if (!parseLong(start, entry.start) || !parseLong(end, entry.end))
+            continue;
+
+        /*
+         * Times restart from zero for every run of ninja, so going backwards
+         * means a new build started.
+         */
+        if (entry.end < lastEnd)
+            mLastBuild.clear();
+        lastEnd = entry.end;
+
+        mLastBuild.push_back(entry);
+        mLatest[entry.output] = entry;
+    }
+
+    return true;
+}
+
+
+const std::vector<NinjaLog::Entry>& NinjaLog::lastBuild() const
+{
+    return mLastBuild;
+}
+
+
+const NinjaLog::Entry* NinjaLog::find(const string& output) const
+{
+    auto it = mLatest.find(output);
+
+    if (it == mLatest.cend())
+        return nullptr;
+
+    return &it->second;
+}
+
+
+long NinjaLog::duration(const string& output, long fallback) const
+{
+    const Entry* entry = find(output);
+
+    return entry == nullptr ? fallback : entry->duration();
+}
+
+
+long NinjaLog::meanDuration(long fallback) const
+{
+    if (mLatest.empty())
+        return fallback;
+
+    long total = 0;
+    for (const auto& pair : mLatest)
+        total += pair.second.duration();
+
+    return total / static_cast<long>(mLatest.size());
+}
+
+
+long NinjaLog::totalDuration(const string& prefix) const
+{
+    long total = 0;
+
+    for (auto it = mLatest.lower_bound(prefix); it != mLatest.cend(); ++it) {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+            break;
+        total += it->second.duration();
+    }
+
+    return total;
+}
+
+
+bool NinjaLog::empty() const
+{
+    return mLatest.empty();
+}
+
+
+string defaultNinjaLog(const string& builddir)
+{
+    if (builddir.empty())
+        return ".ninja_log";
+
+    return builddir + "/.ninja_log";
+}
@@ -0,0 +1,87 @@
+#ifndef NGEN_NINJALOG__HPP
+#define NGEN_NINJALOG__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** Reader for ninja's .ninja_log.
+ *
+ * Ninja keeps appending to the log, so it holds several builds. Entries are
+ * available for the most recent build, and the most recent time recorded
+ * for any output.
+ */
+class NinjaLog
+{
+  public:
+    using string = std::string;
+
+    /** One line of the log. Times are milliseconds since ninja started.
+     */
+    struct Entry
+    {
+        long start;
+        long end;
+        string output;
+        string hash;
+
+        long duration() const { return end - start; }
+    };
+
+    NinjaLog();
+
+    /** Load path.
+     *
+     * @returns false on failure, with a message on std::clog.
+     */
+    bool load(const string& path);
+
+    /** Returns the entries of the last build in the log.
+     */
+    const std::vector<Entry>& lastBuild() const;
+
+    /** Returns the most recent entry for output, or nullptr.
+     */
+    const Entry* find(const string& output) const;
+
+    /** Returns find(output)->duration(), or fallback if there is none.
+     */
+    long duration(const string& output, long fallback) const;
+
+    /** Returns the mean of all known durations, or fallback if empty.
+     */
+    long meanDuration(long fallback) const;
+
+    /** Returns the sum of the most recent durations for outputs under prefix.
+     */
+    long totalDuration(const string& prefix) const;
+
+    bool empty() const;
+
+  private:
+    std::vector<Entry> mLastBuild;
+    std::map<string, Entry> mLatest;
+};
+
+/** Returns the default location of .ninja_log for a builddir.
+ *
+ * Ninja puts it in the top level $builddir when that is set.
+ */
+std::string defaultNinjaLog(const std::string& builddir);
+
+#endif // NGEN_NINJALOG__HPP
@@ -15,11 +15,18 @@
  */
 
 #include "Bundle.hpp"
+#include "Manifest.hpp"
 #include "Shinobi.hpp"
 #include "Statement.hpp"
+#include "distribute.hpp"
+#include "path.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <thread>
 
 using std::endl;
 using std::quoted;
@@ -32,6 +39,8 @@ Shinobi::Shinobi(Bundle& bundle)
         { "c_library", "c_compile" },
         { "cxx_application", "cxx_compile" },
         { "cxx_library", "cxx_compile" },
+        { "c_static_library", "c_compile" },
+        { "cxx_static_library", "cxx_compile" },
         { "cs_application", "cs_compile" },
         { "java_application", "java_compile" },
         { "java_library", "java_compile" },
@@ -44,6 +53,8 @@ Shinobi::Shinobi(Bundle& bundle)
         { "c_library", "c_library" },
         { "cxx_application", "cxx_application" },
         { "cxx_library", "cxx_library" },
+        { "c_static_library", "c_static_library" },
+        { "cxx_static_library", "cxx_static_library" },
         { "cs_application", "cs_application" },
         { "cs_library", "cs_library" },
         { "java_application", "java_application" },
@@ -75,6 +86,16 @@ bool Shinobi::generate()
         return false;
     }
 
+    /*
+     * Ninja's default statements are global, so only the top level knows
+     * every root, package children included.
+     */
+    if (b.toplevel && !b.onRequest->empty()) {
+        b.output.close();
+        if (!writeDefault(b.outputpath))
+            return false;
+    }
+
     return true;
 }
 
@@ -120,6 +141,13 @@ bool Shinobi::generateProject(const json& project)
         << endl
         ;
 
+    if (mBundle.toplevel && !generatePools(project)) {
+        error() << "failed to generate pools" << endl;
+        return false;
+    } else if (!mBundle.toplevel && has(project, "pools")) {
+        warning() << "pools are only taken from the top level project; ignoring them." << endl;
+    }
+
     if (!generateVariables(project)) {
         error() << "failed to generate variables" << endl;
         return false;
@@ -182,6 +210,22 @@ bool Shinobi::generateProject(const json& project)
         error() << "failed to generate build statements for targetName." << endl;
     }
 
+    if (!generateBuildStatementsForHeadersReady(project, type, rule)) {
+        error() << "failed to generate build statements for headers ready." << endl;
+    }
+
+    if (mBundle.toplevel && !mBundle.launcher.empty()) {
+        if (!generateBuildStatementsForLauncher()) {
+            error() << "failed to generate build statements for launcher." << endl;
+        }
+    }
+
+    if (mBundle.toplevel && mBundle.recordUsage) {
+        if (!generateBuildStatementsForUsageSummary()) {
+            error() << "failed to generate build statements for usage summary." << endl;
+        }
+    }
+
     return true;
 }
 
@@ -268,6 +312,14 @@ bool Shinobi::generateVariables(const json& project)
         << endl
         ;
 
+    if (mBundle.recordUsage) {
+        output()
+            << "# records what each edge takes: time, memory, I/O and exit status." << endl
+            << "measure = " << mBundle.self << " --measure " << mBundle.usagePath << " " << projectName() << endl
+            << endl
+            ;
+    }
+
     if (has(projectData(), "variables")) {
         output()
             << "# Variables from the /variables block. Exported for children of this package." << endl
@@ -301,7 +353,7 @@ bool Shinobi::generateRules()
         << endl
         ;
 #else
-    output() << "    command = (cd $$(dirname $in) && ./$$(basename $in) $args)" << endl;
+    output() << "    command = (cd $$(dirname $in) && " << measured("./$$(basename $in) $args") << ")" << endl;
 #endif
 
     output()
@@ -328,7 +380,7 @@ bool Shinobi::generateRules()
 #if defined(_WIN32) || defined(__WIN64)
         << "    command = Powershell Copy-Item -Force -Path $in -Destination $out" << endl
 #else
-        << "    command = install $in $out" << endl
+        << "    command = " << measured("install $in $out") << endl
 #endif
         << endl
         ;
@@ -340,11 +392,24 @@ bool Shinobi::generateRules()
 #if defined(_WIN32) || defined(__WIN64)
         << "    command = Powershell Copy-Item -Force -Path $in -Destination $out" << endl 
 #else
-        << "    command = cp $in $out" << endl
+        << "    command = " << measured("cp $in $out") << endl
 #endif
         << endl
         ;
 
+    if (mBundle.bulkInstall) {
+        output()
+            << "# install non-executable files in one process, keeping unchanged ones" << endl
+            << "rule install_files" << endl
+            << "    description = INSTALL $out" << endl
+            << "    restat = true" << endl
+            << "    rspfile = $out.rsp" << endl
+            << "    rspfile_content = $pairs" << endl
+            << "    command = " << measured(mBundle.self + " --install-files $out.rsp $out") << endl
+            << endl
+            ;
+    }
+
     output() << endl ;
 
     return true;
@@ -384,6 +449,11 @@ bool Shinobi::generateBuildStatementsForInstall(const json& project, const strin
     if (debug())
         log() << "generateBuildStatementsForInstall(): project: " << projectName() << " type: " << type << " rule: " << rule << endl;
 
+    /*
+     * Executables keep their own edges, to be made executable.
+     */
+    list inputs, outputs;
+
     if (has(project, "install_files")) {
         for (const json& obj : project.at("install_files")) {
             string input = sourcedir(obj.at("input"));
@@ -391,6 +461,12 @@ bool Shinobi::generateBuildStatementsForInstall(const json& project, const strin
 
             bool exe = has(obj, "executable") ? obj.at("executable").get<bool>() : false;
 
+            if (mBundle.bulkInstall && !exe) {
+                inputs.push_back(input);
+                outputs.push_back(output);
+                continue;
+            }
+
             Statement install_file(exe ? rule : "copy");
 
             install_file
@@ -402,10 +478,36 @@ bool Shinobi::generateBuildStatementsForInstall(const json& project, const strin
         }
     }
 
+    if (!inputs.empty())
+        generateBulkInstall("$builddir/install_files.stamp", inputs, outputs);
+
     return true;
 }
 
 
+void Shinobi::generateBulkInstall(const string& stamp, const list& inputs, const list& outputs)
+{
+    string pairs;
+
+    for (size_t i=0; i < inputs.size(); ++i) {
+        if (!pairs.empty())
+            pairs += " ";
+        pairs += inputs.at(i) + " " + outputs.at(i);
+    }
+
+    Statement install("install_files");
+
+    install
+        .appendInputs(inputs)
+        .appendOutput(stamp)
+        .appendImplicitOutputs(outputs)
+        .appendVariable("pairs", pairs)
+        ;
+
+    output() << install << endl;
+}
+
+
 bool Shinobi::generateBuildStatementsForTargetName(const json& project, const string& type, const string& rule)
 {
     (void)project;
@@ -415,6 +517,31 @@ bool Shinobi::generateBuildStatementsForTargetName(const json& project, const st
 }
 
 
+bool Shinobi::generateBuildStatementsForHeadersReady(const json& project, const string& type, const string& rule)
+{
+    (void)project;
+    if (debug())
+        log() << "generateBuildStatementsForHeadersReady(): project: " << projectName() << " type: " << type << " rule: " << rule << endl;
+
+    /*
+     * Applications and packages phony their $sourcedir/, so nothing names them.
+     */
+    if (type == "package" || isApplicationType(type))
+        return true;
+
+    Statement ready(rule);
+
+    ready
+        .appendInput(targetName())
+        .appendOutput(headersReady(targetName()))
+        ;
+
+    output() << ready << endl;
+
+    return true;
+}
+
+
 bool Shinobi::generateBuildStatementsForExternal(const json& project, const string& type, const string& rule)
 {
     (void)project;
@@ -433,6 +560,251 @@ bool Shinobi::generateBuildStatementsForPackage(const json& project, const strin
 }
 
 
+bool Shinobi::generatePools(const json& project)
+{
+    return writePools(output(), project);
+}
+
+
+bool Shinobi::writePools(std::ostream& out, const json& project)
+{
+    static const char* indent = "    ";
+    static const uintmax_t gib = 1024 * 1024 * 1024;
+
+    /*
+     * Guess a link with debug info wants 4 GiB, and a heavy compile 2 GiB.
+     * Never more than there are cores, never less than one.
+     */
+    uintmax_t cores = std::max(1u, std::thread::hardware_concurrency());
+    uintmax_t ram = physicalMemory();
+
+    auto depth = [cores, ram](uintmax_t each) {
+        if (ram == 0)
+            return std::max<uintmax_t>(1, cores / 2);
+        return std::max<uintmax_t>(1, std::min(cores, ram / each));
+    };
+
+    /*
+     * An LTO link runs its own jobs in parallel, so there's fewer of those.
+     */
+    std::map<string, uintmax_t> pools = {
+        { "link_pool", depth(4 * gib) },
+        { "heavy", depth(2 * gib) },
+        { "lto_pool", std::max<uintmax_t>(1, std::min(cores / 8, ram / (8 * gib))) },
+    };
+
+    /*
+     * Compiles sent to other machines are only limited by how many they
+     * take, as distcc does. Links are left to link_pool.
+     */
+    std::vector<DistHost> hosts;
+    if (!mBundle.distribute.empty() && parseDistHosts(mBundle.distribute, hosts)) {
+        uintmax_t jobs = 0;
+        for (const DistHost& host : hosts)
+            jobs += host.jobs;
+        pools["distcc"] = jobs;
+    }
+
+    /*
+     * Compiles that were measured go by how much they took instead. Only the
+     * classes that can't run one per core need a pool.
+     */
+    if (mBundle.usage) {
+        for (uintmax_t bound = memoryClassMin; ram != 0; bound *= 2) {
+            uintmax_t width = std::max<uintmax_t>(1, ram / 10 * 9 / bound);
+            if (width < cores)
+                pools[memoryPool(bound)] = width;
+            if (bound >= ram)
+                break;
+        }
+    }
+
+    if (has(project, "pools")) {
+        for (const auto& pool : project.at("pools").items()) {
+            if (pool.key() == "console") {
+                warning() << "the console pool is built in; ignoring it." << endl;
+                continue;
+            }
+            pools[pool.key()] = pool.value().get<uintmax_t>();
+        }
+    }
+
+    out << "# limits on concurrent edges, shared by every subninja." << endl;
+    for (const auto& pool : pools) {
+        out
+            << "pool " << pool.first << endl
+            << indent << "depth = " << pool.second << endl
+            << endl
+            ;
+    }
+
+    return true;
+}
+
+
+Shinobi::string Shinobi::memoryPool(uintmax_t bytes)
+{
+    uintmax_t cores = std::max(1u, std::thread::hardware_concurrency());
+    uintmax_t ram = physicalMemory();
+
+    if (ram == 0)
+        return "";
+
+    /*
+     * Round up to the class that holds bytes, named for its bound.
+     */
+    uintmax_t bound = memoryClassMin;
+    while (bound < bytes && bound < ram)
+        bound *= 2;
+
+    if (std::max<uintmax_t>(1, ram / 10 * 9 / bound) >= cores)
+        return "";
+
+    static const uintmax_t mib = 1024 * 1024;
+    if (bound >= 1024 * mib)
+        return "mem_" + std::to_string(bound / (1024 * mib)) + "g";
+    return "mem_" + std::to_string(bound / mib) + "m";
+}
+
+
+bool Shinobi::generateBuildStatementsForLauncher()
+{
+    static const char* indent = "    ";
+
+    /*
+     * ccache and sccache both know --show-stats and --zero-stats; anything
+     * else is on its own. Except the object cache, which is ngen's own.
+     */
+    string launcher = mBundle.launcher;
+    string tool = filename(launcher.substr(0, launcher.find(' ')));
+    string showStats = "--show-stats";
+    string zeroStats = "--zero-stats";
+
+    if (!mBundle.objectCache.empty()) {
+        tool = mBundle.self;
+        showStats = "--object-cache-stats " + mBundle.objectCache;
+        zeroStats = "--object-cache-zero " + mBundle.objectCache;
+    } else if (tool != "ccache" && tool != "sccache") {
+        if (debug())
+            log() << "no stats for launcher " << launcher << endl;
+        return true;
+    }
+
+    output()
+        << "# report the compiler cache's statistics." << endl
+        << "rule launcher_stats" << endl
+        << indent << "description = " << tool << " $flags" << endl
+        << indent << "pool = console" << endl
+        << indent << "command = " << tool << " $flags" << endl
+        << endl
+        ;
+
+    onRequest("launcher-stats");
+    onRequest("launcher-zero");
+
+    Statement stats("launcher_stats");
+    stats
+        .appendOutput("launcher-stats")
+        .appendVariable("flags", showStats)
+        ;
+
+    Statement zero("launcher_stats");
+    zero
+        .appendOutput("launcher-zero")
+        .appendVariable("flags", zeroStats)
+        ;
+
+    output() << stats << endl << zero << endl;
+
+    return true;
+}
+
+
+bool Shinobi::generateBuildStatementsForUsageSummary()
+{
+    static const char* indent = "    ";
+
+    output()
+        << "# summarize the usage log per project, and as OpenMetrics." << endl
+        << "rule usage_summary" << endl
+        << indent << "description = SUMMARY $metrics" << endl
+        << indent << "pool = console" << endl
+        << indent << "command = " << mBundle.self << " --usage-summary " << mBundle.usagePath << " $metrics" << endl
+        << endl
+        ;
+
+    onRequest("usage-summary");
+
+    Statement summary("usage_summary");
+    summary
+        .appendOutput("usage-summary")
+        .appendVariable("metrics", "$builddir/usage.om")
+        ;
+
+    output() << summary << endl;
+
+    return true;
+}
+
+
+void Shinobi::onRequest(const string& target)
+{
+    mBundle.onRequest->insert(target);
+}
+
+
+bool Shinobi::writeDefault(const string& path) const
+{
+    if (mBundle.onRequest->empty())
+        return true;
+
+    Manifest manifest;
+    if (!manifest.load(path)) {
+        error() << "cannot read back " << path << " for its default targets." << endl;
+        return false;
+    }
+
+    list targets;
+    for (const Manifest::Edge& edge : manifest.edges()) {
+        for (const list* outputs : { &edge.outputs, &edge.implicitOutputs }) {
+            for (const string& target : *outputs) {
+                if (manifest.consumers(target, true).empty() && mBundle.onRequest->count(target) == 0)
+                    targets.push_back(target);
+            }
+        }
+    }
+
+    if (targets.empty())
+        return true;
+
+    std::ofstream out(path, std::ios::app);
+
+    out << endl << "# everything but the targets only built on request." << endl << "default";
+    for (const string& target : targets)
+        out << " " << target;
+    out << endl;
+
+    if (!out) {
+        error() << "cannot write the default targets to " << path << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+Shinobi::string Shinobi::measured(const string& command) const
+{
+    if (!mBundle.recordUsage)
+        return command;
+
+    /*
+     * $out is only known in the rule, a top level binding sees it empty.
+     */
+    return "$measure $out " + command;
+}
+
+
 Shinobi::string Shinobi::generatorName() const
 {
     return "Shinobi";
@@ -459,6 +831,23 @@ Shinobi::string Shinobi::targetName() const
 }
 
 
+Shinobi::string Shinobi::headersReady(const string& name)
+{
+    return name + "-headers";
+}
+
+
+Shinobi::list Shinobi::headersReady(const json& names)
+{
+    list r;
+
+    for (const string& name : names)
+        r.push_back(headersReady(name));
+
+    return r;
+}
+
+
 Shinobi::string Shinobi::projectName() const
 {
     return mBundle.project.at("project");
@@ -534,6 +923,24 @@ Shinobi::string Shinobi::distdir(const string& source) const
 }
 
 
+Shinobi::string Shinobi::resolve(const string& path) const
+{
+    static const std::pair<const char*, string Bundle::*> dirs[] = {
+        { "$sourcedir", &Bundle::sourcedir },
+        { "$builddir", &Bundle::builddir },
+        { "$distdir", &Bundle::distdir },
+    };
+
+    for (const auto& dir : dirs) {
+        string var = dir.first;
+        if (path.compare(0, var.size(), var) == 0)
+            return lexically_normal(mBundle.*dir.second + path.substr(var.size()));
+    }
+
+    return lexically_normal(path);
+}
+
+
 Shinobi::string Shinobi::compileRule(const string& type) const
 {
     auto it = mCompileRules.find(type);
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -105,6 +106,14 @@ class Shinobi
      */
     virtual bool generateBuildStatementsForInstall(const json& project, const string& type, const string& rule);
 
+    /** Generate one install_files edge copying each of inputs to the
+     * output at the same index, for --bulk-install.
+     *
+     * Every output is still declared, as an implicit output, so dependents
+     * depend on the files themselves rather than on stamp.
+     */
+    void generateBulkInstall(const string& stamp, const list& inputs, const list& outputs);
+
     /** Generate an all like phony for this project's targetName.
      *
      * This is used so a package's subninja can be invoked by the targetName.
@@ -112,6 +121,14 @@ class Shinobi
      */
     virtual bool generateBuildStatementsForTargetName(const json& project, const string& type, const string& rule);
 
+    /** Generate the headersReady() phony for this project's targetName.
+     *
+     * Dependents compile once that's built, rather than waiting on the whole
+     * of targetName. By default it is the whole of targetName, since what a
+     * dependent includes is unknown.
+     */
+    virtual bool generateBuildStatementsForHeadersReady(const json& project, const string& type, const string& rule);
+
     /** Generate ...
      *
      * @param project reference to the project.
@@ -128,6 +145,42 @@ class Shinobi
      */
     virtual bool generateBuildStatementsForPackage(const json& project, const string& type, const string& rule);
 
+    /** Generate the pools edges can be limited by.
+     *
+     * Ninja's pools are global, so these are only declared by the top level
+     * project, and subninjas use the same ones. There's always link_pool,
+     * used by links, heavy, for compiles that are known to need a lot of
+     * memory, and lto_pool for LTO links. Their depths default to what RAM
+     * and cores allow for, and
+     * /project/pools can set those or declare more, e.g. { "link_pool": 2 }.
+     *
+     * When there's a usage log, there's also a mem_* pool for each memory
+     * class that would run out of RAM before it ran out of cores.
+     */
+    virtual bool generatePools(const json& project);
+
+    /** Write the pools generatePools() declares to out.
+     */
+    bool writePools(std::ostream& out, const json& project);
+
+    /** Returns the pool for an edge that peaks at bytes of memory.
+     *
+     * Classes double from memoryClassMin, and each may take 90% of RAM. Empty
+     * if the class can run on every core at once, so needs no pool.
+     */
+    static string memoryPool(uintmax_t bytes);
+
+    /** The smallest memory class, 256 MiB.
+     */
+    static const uintmax_t memoryClassMin = uintmax_t(256) << 20;
+
+    /** Generate launcher-stats and launcher-zero targets for the launcher.
+     *
+     * Only done for the top level project, since the cache is shared by the
+     * whole tree.
+     */
+    virtual bool generateBuildStatementsForLauncher();
+
     /** Returns the name of the backend.
      */
     virtual string generatorName() const;
@@ -151,6 +204,15 @@ class Shinobi
      */
     virtual string targetName() const;
 
+    /** Returns the target that's built once what dependents of name need
+     * to compile is installed.
+     */
+    static string headersReady(const string& name);
+
+    /** Returns headersReady() of each name.
+     */
+    static list headersReady(const json& names);
+
     /** Returns projectData().at("project") */
     string projectName() const;
 
@@ -177,6 +239,32 @@ class Shinobi
 
     std::ostream& output();
 
+    /** Returns command run through $measure, recording it for $out, when
+     * recording usage, else command as is.
+     */
+    string measured(const string& command) const;
+
+    /** Generate the usage-summary target, for the usage log.
+     *
+     * Only done for the top level project, since the log is the whole tree's.
+     */
+    virtual bool generateBuildStatementsForUsageSummary();
+
+    /** Keep target out of what a plain ninja builds.
+     *
+     * For always dirty tools like launcher-stats, that only make sense when
+     * asked for by name.
+     */
+    void onRequest(const string& target);
+
+    /** Append a default statement to the manifest at path, for every root
+     * but the onRequest() targets.
+     *
+     * Does nothing when there are none, since then ninja's own default is
+     * already every root.
+     */
+    bool writeDefault(const string& path) const;
+
     /* Returns $sourcedir/source
      */
     string sourcedir(const string& source) const;
@@ -189,6 +277,11 @@ class Shinobi
      */
     string distdir(const string& source) const;
 
+    /** Returns path with a leading $sourcedir, $builddir, or $distdir replaced
+     * by its value, as ninja would see it.
+     */
+    string resolve(const string& path) const;
+
     /** Returns the rule name for compiling objects.
      */
     string compileRule(const string& type) const;
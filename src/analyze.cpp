@@ -0,0 +1,489 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "analyze.hpp"
+
+#include "Manifest.hpp"
+#include "NinjaLog.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <vector>
+
+using json = nlohmann::json;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace {
+
+/*
+ * Edge indexes of a Manifest, with what they wait on and a topological
+ * order to walk them in.
+ */
+struct Graph
+{
+    const Manifest& manifest;
+
+    /* Edges producing an input, implicit, or order-only dependency. */
+    vector<vector<size_t>> predecessors;
+
+    /* Same, but only through order-only dependencies. */
+    vector<std::set<size_t>> orderOnly;
+
+    vector<size_t> order;
+
+    Graph(const Manifest& m);
+};
+
+
+Graph::Graph(const Manifest& m)
+    : manifest(m)
+    , predecessors(m.edges().size())
+    , orderOnly(m.edges().size())
+    , order()
+{
+    const auto& edges = m.edges();
+    vector<vector<size_t>> successors(edges.size());
+    vector<size_t> waiting(edges.size(), 0);
+
+    for (size_t i=0; i < edges.size(); ++i) {
+        const Manifest::Edge& edge = edges[i];
+        std::set<size_t> preds;
+
+        auto add = [&](const Manifest::list& paths, bool oo) {
+            for (const string& path : paths) {
+                const Manifest::Edge* producer = m.producer(path);
+                if (producer == nullptr)
+                    continue;
+                size_t p = m.index(*producer);
+                if (p == i)
+                    continue;
+                preds.insert(p);
+                if (oo)
+                    orderOnly[i].insert(p);
+            }
+        };
+
+        add(edge.inputs, false);
+        add(edge.implicitDependencies, false);
+        add(edge.orderOnlyDependencies, true);
+
+        for (size_t p : preds) {
+            predecessors[i].push_back(p);
+            successors[p].push_back(i);
+        }
+        waiting[i] = preds.size();
+    }
+
+    std::deque<size_t> ready;
+    for (size_t i=0; i < edges.size(); ++i) {
+        if (waiting[i] == 0)
+            ready.push_back(i);
+    }
+
+    while (!ready.empty()) {
+        size_t i = ready.front();
+        ready.pop_front();
+        order.push_back(i);
+
+        for (size_t s : successors[i]) {
+            if (--waiting[s] == 0)
+                ready.push_back(s);
+        }
+    }
+
+    /* Ninja would reject a cycle, but don't loop forever if one sneaks in. */
+    if (order.size() != edges.size()) {
+        std::clog << "warning: build graph has a cycle, analysis is incomplete." << endl;
+        for (size_t i=0; i < edges.size(); ++i) {
+            if (waiting[i] != 0)
+                order.push_back(i);
+        }
+    }
+}
+
+} // namespace
+
+
+/*
+ * Quote for DOT. Unlike std::quoted, leave backslashes alone so \n works.
+ */
+static string dotQuote(const string& s)
+{
+    string r = "\"";
+
+    for (char c : s) {
+        if (c == '"')
+            r.push_back('\\');
+        r.push_back(c);
+    }
+
+    return r + "\"";
+}
+
+
+bool analyzeGraph(std::ostream& os, const Manifest& manifest, const NinjaLog* log, const string& prefix)
+{
+    const auto& edges = manifest.edges();
+    Graph graph(manifest);
+
+    bool useLog = log != nullptr && !log->empty();
+    long fallback = useLog ? log->meanDuration(1) : 1;
+
+    vector<long> weight(edges.size(), 0);
+    vector<long> finish(edges.size(), 0);
+    vector<size_t> depth(edges.size(), 0);
+    vector<size_t> via(edges.size(), SIZE_MAX);
+
+    for (size_t i : graph.order) {
+        const Manifest::Edge& edge = edges[i];
+        bool phony = edge.rule == "phony";
+
+        if (!phony)
+            weight[i] = useLog ? log->duration(edge.outputs.front(), fallback) : 1;
+
+        long start = 0;
+        size_t d = 0;
+        for (size_t p : graph.predecessors[i]) {
+            if (via[i] == SIZE_MAX || finish[p] > start) {
+                start = finish[p];
+                via[i] = p;
+            }
+            d = std::max(d, depth[p]);
+        }
+
+        finish[i] = start + weight[i];
+        depth[i] = d + (phony ? 0 : 1);
+    }
+
+    /*
+     * Totals, per project, and per depth.
+     */
+
+    long work = 0;
+    size_t count = 0;
+    json projects = json::object();
+    vector<size_t> widths;
+
+    for (size_t i=0; i < edges.size(); ++i) {
+        const Manifest::Edge& edge = edges[i];
+        if (edge.rule == "phony")
+            continue;
+
+        work += weight[i];
+        count++;
+
+        json& p = projects[manifest.project(edge)];
+        if (p.empty())
+            p = { { "edges", 0 }, { "work", 0 }, { "kinds", json::object() } };
+        p["edges"] = p["edges"].get<size_t>() + 1;
+        p["work"] = p["work"].get<long>() + weight[i];
+
+        string kind = Manifest::kind(edge.rule);
+        p["kinds"][kind] = p["kinds"].value(kind, 0) + 1;
+
+        if (widths.size() < depth[i])
+            widths.resize(depth[i], 0);
+        widths[depth[i] - 1]++;
+    }
+
+    /*
+     * Walk back from whatever finishes last for the critical path.
+     */
+
+    size_t last = SIZE_MAX;
+    for (size_t i=0; i < edges.size(); ++i) {
+        if (last == SIZE_MAX || finish[i] > finish[last])
+            last = i;
+    }
+
+    json chain = json::array();
+    std::set<string> criticalProjects;
+    for (size_t i = last; i != SIZE_MAX; i = via[i]) {
+        const Manifest::Edge& edge = edges[i];
+        if (edge.rule == "phony")
+            continue;
+        chain.insert(chain.begin(), json{
+            { "output", edge.outputs.front() },
+            { "project", manifest.project(edge) },
+            { "kind", Manifest::kind(edge.rule) },
+            { "weight", weight[i] },
+        });
+        criticalProjects.insert(manifest.project(edge));
+    }
+    long length = last == SIZE_MAX ? 0 : finish[last];
+
+    /*
+     * Order-only dependencies: who waits on them, and how late they can be
+     * ready at the earliest.
+     */
+
+    std::map<string, std::pair<size_t, std::set<string>>> gates;
+    for (const Manifest::Edge& edge : edges) {
+        for (const string& dep : edge.orderOnlyDependencies) {
+            auto& gate = gates[dep];
+            gate.first++;
+            gate.second.insert(manifest.project(edge));
+        }
+    }
+
+    json orderOnly = json::array();
+    for (const auto& gate : gates) {
+        const Manifest::Edge* producer = manifest.producer(gate.first);
+        long ready = producer == nullptr ? 0 : finish[manifest.index(*producer)];
+
+        orderOnly.push_back({
+            { "target", gate.first },
+            { "gated_edges", gate.second.first },
+            { "ready_at", ready },
+            { "projects", gate.second.second },
+        });
+    }
+    std::sort(orderOnly.begin(), orderOnly.end(), [](const json& a, const json& b) {
+        long wa = a["ready_at"].get<long>() * static_cast<long>(a["gated_edges"].get<size_t>());
+        long wb = b["ready_at"].get<long>() * static_cast<long>(b["gated_edges"].get<size_t>());
+        return wa > wb;
+    });
+
+    size_t maxWidth = widths.empty() ? 0 : *std::max_element(widths.begin(), widths.end());
+
+    json report = {
+        { "weights", useLog ? "ninja_log" : "unit" },
+        { "edges", count },
+        { "work", work },
+        { "critical_path", { { "length", length }, { "edges", chain } } },
+        { "parallelism", length == 0 ? 0.0 : static_cast<double>(work) / static_cast<double>(length) },
+        { "width_by_depth", widths },
+        { "max_width", maxWidth },
+        { "projects", projects },
+        { "order_only", orderOnly },
+    };
+
+    std::ofstream out(prefix + ".json", std::ios::out | std::ios::trunc);
+    if (!out) {
+        std::clog << "cannot create " << prefix << ".json" << endl;
+        return false;
+    }
+    out << report.dump(4) << endl;
+
+    /*
+     * The DOT graph is per project. A per edge graph is unreadable past a
+     * few hundred edges.
+     */
+
+    std::ofstream dot(prefix + ".dot", std::ios::out | std::ios::trunc);
+    if (!dot) {
+        std::clog << "cannot create " << prefix << ".dot" << endl;
+        return false;
+    }
+
+    dot << "digraph ngen {" << endl
+        << "    rankdir = LR;" << endl
+        << "    node [shape = box];" << endl
+        ;
+    for (auto it = projects.cbegin(); it != projects.cend(); ++it) {
+        dot << "    " << dotQuote(it.key())
+            << " [label = " << dotQuote(it.key() + "\\n" + std::to_string(it.value()["edges"].get<size_t>())
+                + " edges, work " + std::to_string(it.value()["work"].get<long>()))
+            ;
+        if (criticalProjects.count(it.key()))
+            dot << ", color = red";
+        dot << "];" << endl;
+    }
+
+    /* project -> dependency -> only reached through order-only? */
+    std::map<std::pair<string, string>, bool> links;
+    for (size_t i=0; i < edges.size(); ++i) {
+        string from = manifest.project(edges[i]);
+        for (size_t p : graph.predecessors[i]) {
+            string to = manifest.project(edges[p]);
+            if (from == to || !projects.contains(from) || !projects.contains(to))
+                continue;
+            bool oo = graph.orderOnly[i].count(p) != 0;
+            auto key = std::make_pair(from, to);
+            auto found = links.find(key);
+            links[key] = found == links.end() ? oo : (found->second && oo);
+        }
+    }
+    for (const auto& link : links) {
+        dot << "    " << dotQuote(link.first.second) << " -> " << dotQuote(link.first.first);
+        if (link.second)
+            dot << " [style = dashed]";
+        dot << ";" << endl;
+    }
+    dot << "}" << endl;
+
+    os  << "edges: " << count << endl
+        << "work: " << work << (useLog ? " ms" : "") << endl
+        << "critical path: " << length << (useLog ? " ms" : "") << " over " << chain.size() << " edges" << endl
+        << "parallelism: " << std::fixed << std::setprecision(2) << report["parallelism"].get<double>() << endl
+        << "max width: " << maxWidth << " at " << widths.size() << " depths" << endl
+        ;
+    for (size_t i=0; i < orderOnly.size() && i < 10; ++i) {
+        const json& gate = orderOnly[i];
+        os << "order-only: " << gate["target"].get<string>()
+            << " gates " << gate["gated_edges"].get<size_t>() << " edges, ready at "
+            << gate["ready_at"].get<long>() << endl;
+    }
+
+    return true;
+}
+
+
+bool analyzeLog(std::ostream& os, const Manifest& manifest, const NinjaLog& log, size_t top, const string& tracePath)
+{
+    const auto& edges = manifest.edges();
+    Graph graph(manifest);
+
+    /*
+     * An edge with several outputs is logged once per output. Keep one entry
+     * per edge, and anything we can't map as it's own thing.
+     */
+
+    struct Run
+    {
+        const NinjaLog::Entry* entry;
+        string project;
+        string kind;
+    };
+
+    vector<Run> runs;
+    vector<long> duration(edges.size(), 0);
+    std::set<size_t> seen;
+
+    for (const NinjaLog::Entry& entry : log.lastBuild()) {
+        const Manifest::Edge* edge = manifest.producer(entry.output);
+
+        if (edge == nullptr) {
+            runs.push_back({ &entry, "?", "unknown" });
+            continue;
+        }
+
+        size_t i = manifest.index(*edge);
+        if (!seen.insert(i).second)
+            continue;
+
+        duration[i] = entry.duration();
+        runs.push_back({ &entry, manifest.project(*edge), Manifest::kind(edge->rule) });
+    }
+
+    /*
+     * Critical path per project only follows edges within that project, so
+     * it's how long the project would take given infinite cores and its
+     * dependencies already built.
+     */
+
+    vector<long> finish(edges.size(), 0);
+    std::map<string, std::pair<long, long>> projects;
+
+    for (size_t i : graph.order) {
+        string project = manifest.project(edges[i]);
+        long start = 0;
+
+        for (size_t p : graph.predecessors[i]) {
+            if (manifest.project(edges[p]) == project)
+                start = std::max(start, finish[p]);
+        }
+
+        finish[i] = start + duration[i];
+        if (duration[i] > 0) {
+            auto& totals = projects[project];
+            totals.first += duration[i];
+            totals.second = std::max(totals.second, finish[i]);
+        }
+    }
+
+    long wall = 0;
+    for (const Run& run : runs)
+        wall = std::max(wall, run.entry->end);
+
+    os << "last build: " << runs.size() << " edges, " << wall << " ms" << endl << endl;
+
+    vector<std::pair<string, std::pair<long, long>>> byTotal(projects.begin(), projects.end());
+    std::sort(byTotal.begin(), byTotal.end(), [](const auto& a, const auto& b) {
+        return a.second.first > b.second.first;
+    });
+
+    os << std::left << std::setw(32) << "project" << std::setw(14) << "total ms" << "critical path ms" << endl;
+    for (const auto& row : byTotal)
+        os << std::left << std::setw(32) << row.first << std::setw(14) << row.second.first << row.second.second << endl;
+    os << endl;
+
+    vector<const Run*> slowest;
+    for (const Run& run : runs)
+        slowest.push_back(&run);
+    std::sort(slowest.begin(), slowest.end(), [](const Run* a, const Run* b) {
+        return a->entry->duration() > b->entry->duration();
+    });
+
+    os << "slowest " << std::min(top, slowest.size()) << " edges:" << endl;
+    for (size_t i=0; i < slowest.size() && i < top; ++i) {
+        const Run* run = slowest[i];
+        os << std::right << std::setw(10) << run->entry->duration() << " ms  "
+            << std::left << std::setw(8) << run->kind << ' '
+            << run->project << ": " << run->entry->output << endl;
+    }
+
+    /*
+     * Chrome trace. Ninja doesn't record which of its jobs ran an edge, so
+     * put each one on the first lane that was free when it started.
+     */
+
+    vector<const Run*> byStart;
+    for (const Run& run : runs)
+        byStart.push_back(&run);
+    std::sort(byStart.begin(), byStart.end(), [](const Run* a, const Run* b) {
+        return a->entry->start < b->entry->start;
+    });
+
+    vector<long> lanes;
+    json events = json::array();
+
+    for (const Run* run : byStart) {
+        size_t lane = 0;
+        while (lane < lanes.size() && lanes[lane] > run->entry->start)
+            ++lane;
+        if (lane == lanes.size())
+            lanes.push_back(0);
+        lanes[lane] = run->entry->end;
+
+        events.push_back({
+            { "name", run->entry->output },
+            { "cat", run->kind },
+            { "ph", "X" },
+            { "ts", run->entry->start * 1000 },
+            { "dur", run->entry->duration() * 1000 },
+            { "pid", 0 },
+            { "tid", lane },
+            { "args", { { "project", run->project } } },
+        });
+    }
+
+    std::ofstream trace(tracePath, std::ios::out | std::ios::trunc);
+    if (!trace) {
+        std::clog << "cannot create " << tracePath << endl;
+        return false;
+    }
+    trace << json{ { "traceEvents", events }, { "displayTimeUnit", "ms" } }.dump() << endl;
+
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef NGEN_ANALYZE__HPP
+#define NGEN_ANALYZE__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Build graph analytics over generated manifests.
+ */
+
+#include <iostream>
+#include <string>
+
+class Manifest;
+class NinjaLog;
+
+/** Analyze the static edge graph of manifest.
+ *
+ * Computes edges per project, the longest dependency chain, the number of
+ * edges that could run at each depth, and the order-only dependencies that
+ * edges wait on. Writes prefix.json and prefix.dot, and a summary to os.
+ *
+ * @param log weights edges by their last recorded duration if not null.
+ * Otherwise every edge weighs 1.
+ *
+ * @returns false if an output cannot be created.
+ */
+bool analyzeGraph(std::ostream& os, const Manifest& manifest, const NinjaLog* log, const std::string& prefix);
+
+/** Analyze the last build recorded in log against manifest.
+ *
+ * Each output is mapped back to its project and kind of edge. Reports the
+ * total and critical path time per project, and the slowest edges. Writes a
+ * Chrome trace (chrome://tracing, Perfetto) of the build to tracePath.
+ *
+ * @param top how many of the slowest edges to report.
+ *
+ * @returns false if tracePath cannot be created.
+ */
+bool analyzeLog(std::ostream& os, const Manifest& manifest, const NinjaLog& log, size_t top, const std::string& tracePath);
+
+#endif // NGEN_ANALYZE__HPP
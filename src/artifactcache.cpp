@@ -0,0 +1,165 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "artifactcache.hpp"
+
+#include "filesystem.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+using std::endl;
+using std::string;
+
+
+string treeDigest(const string& dir)
+{
+    std::vector<string> files;
+    std::error_code ec;
+
+    for (auto& entry : fs::recursive_directory_iterator(dir, ec)) {
+        if (entry.is_regular_file(ec) && entry.path().filename() != "build.ninja")
+            files.push_back(entry.path().lexically_relative(dir).generic_string());
+    }
+
+    std::sort(files.begin(), files.end());
+
+    string r;
+    for (const string& file : files) {
+        std::ifstream in((fs::path(dir) / file).string(), std::ios::binary);
+        std::ostringstream content;
+        content << in.rdbuf();
+
+        r += file + " " + sha256(content.str()) + "\n";
+    }
+
+    return r;
+}
+
+
+json findArtifact(const string& store, const string& key)
+{
+    std::ifstream in((fs::path(store) / key / "manifest.json").string());
+
+    if (!in)
+        return nullptr;
+
+    try {
+        json manifest;
+        in >> manifest;
+        return manifest;
+    } catch (std::exception& ex) {
+        std::clog << store << "/" << key << "/manifest.json: " << ex.what() << endl;
+    }
+
+    return nullptr;
+}
+
+
+string artifactFiles(const string& store, const string& key)
+{
+    return (fs::path(store) / key / "files").generic_string();
+}
+
+
+bool publishArtifact(const string& store, const string& metadata, const string& stamp)
+{
+    json manifest;
+
+    try {
+        std::ifstream in(metadata);
+        in >> manifest;
+    } catch (std::exception& ex) {
+        std::clog << metadata << ": " << ex.what() << endl;
+        return false;
+    }
+
+    string key = manifest.at("key");
+    fs::path distdir = manifest.at("distdir").get<string>();
+    fs::path entry = fs::path(store) / key;
+    std::error_code ec;
+
+    if (!fs::exists(entry, ec)) {
+        static std::random_device device;
+        fs::path tmp = fs::path(store) / "tmp" / (key + "." + hex((uint64_t(device()) << 32) | device()));
+
+        for (const string& file : manifest.at("files")) {
+            fs::path to = tmp / "files" / file;
+
+            fs::create_directories(to.parent_path(), ec);
+            if (!fs::copy_file(distdir / file, to, fs::copy_options::overwrite_existing, ec)) {
+                std::clog << "cannot publish " << (distdir / file).string() << ": " << ec.message() << endl;
+                fs::remove_all(tmp, ec);
+                return false;
+            }
+        }
+
+        manifest.erase("distdir");
+        std::ofstream((tmp / "manifest.json").string()) << manifest.dump(4) << endl;
+
+        fs::rename(tmp, entry, ec);
+        if (ec)
+            fs::remove_all(tmp, ec);
+    }
+
+    std::ofstream out(stamp, std::ios::trunc);
+    out << key << endl;
+
+    return static_cast<bool>(out);
+}
+
+
+bool fetchArtifact(const string& store, const string& key, const string& distdir, long timeout)
+{
+    auto start = std::chrono::steady_clock::now();
+    json manifest = findArtifact(store, key);
+
+    if (manifest.is_null())
+        std::clog << "waiting for artifact " << key << " in " << store << endl;
+
+    while (manifest.is_null()) {
+        if (std::chrono::steady_clock::now() - start > std::chrono::seconds(timeout)) {
+            std::clog << "gave up on artifact " << key << " after " << timeout << " seconds" << endl;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        manifest = findArtifact(store, key);
+    }
+
+    fs::path files = artifactFiles(store, key);
+    std::error_code ec;
+
+    for (const string& file : manifest.at("files")) {
+        fs::path to = fs::path(distdir) / file;
+
+        fs::create_directories(to.parent_path(), ec);
+        if (!fs::copy_file(files / file, to, fs::copy_options::overwrite_existing, ec)) {
+            std::clog << "cannot fetch " << (files / file).string() << ": " << ec.message() << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
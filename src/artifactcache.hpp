@@ -0,0 +1,66 @@
+#ifndef NGEN_ARTIFACTCACHE__HPP
+#define NGEN_ARTIFACTCACHE__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A store of the installed outputs of package children, by a key of
+ * everything that went into them.
+ */
+
+#include <nlohmann/json.hpp>
+#include <string>
+
+/** Returns a listing of every file under dir with a SHA-256 of its content.
+ *
+ * Sorted, so it's the same for the same tree. Generated build.ninja files
+ * are left out.
+ */
+std::string treeDigest(const std::string& dir);
+
+/** Returns the manifest store has for key, or null.
+ *
+ * The manifest holds the "target", "type", "artifact" to link with, and the
+ * installed "files", relative to distdir. Their copies are in
+ * artifactFiles(store, key).
+ */
+nlohmann::json findArtifact(const std::string& store, const std::string& key);
+
+/** Returns where store keeps the files for key.
+ */
+std::string artifactFiles(const std::string& store, const std::string& key);
+
+/** Publish the files a metadata file lists, and touch stamp.
+ *
+ * The metadata is a manifest with the "key" and "distdir" the files are
+ * in. The entry is put together to the side and renamed into place, so
+ * a reader never sees half of one. If another build got there first, theirs
+ * is kept.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool publishArtifact(const std::string& store, const std::string& metadata, const std::string& stamp);
+
+/** Copy the files store has for key into distdir.
+ *
+ * If store doesn't have key yet, wait up to timeout seconds for another
+ * build to publish it.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool fetchArtifact(const std::string& store, const std::string& key, const std::string& distdir, long timeout);
+
+#endif // NGEN_ARTIFACTCACHE__HPP
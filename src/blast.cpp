@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "blast.hpp"
+
+#include "Manifest.hpp"
+#include "util.hpp"
+
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+using std::endl;
+using std::setw;
+using std::string;
+
+/*
+ * Edge kinds that cost something to redo. Phony and friends don't count.
+ */
+static const char* kinds[] = { "compile", "link", "install" };
+
+
+CommandHashes commandHashes(const Manifest& manifest)
+{
+    CommandHashes r;
+
+    for (const Manifest::Edge& edge : manifest.edges()) {
+        if (edge.rule == "phony" || edge.outputs.empty())
+            continue;
+
+        r[edge.outputs.front()] = hex(fnv1a(manifest.command(edge)));
+    }
+
+    return r;
+}
+
+
+bool loadCommandHashes(const string& path, CommandHashes& hashes)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    string hash;
+    string output;
+    while (in >> hash && std::getline(in >> std::ws, output))
+        hashes[output] = hash;
+
+    return true;
+}
+
+
+bool saveCommandHashes(const string& path, const CommandHashes& hashes)
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out)
+        return false;
+
+    for (const auto& pair : hashes)
+        out << pair.second << ' ' << pair.first << endl;
+
+    return static_cast<bool>(out);
+}
+
+
+size_t reportBlastRadius(std::ostream& os, const CommandHashes& before, const Manifest& after)
+{
+    const auto& edges = after.edges();
+    CommandHashes now = commandHashes(after);
+
+    std::vector<bool> dirty(edges.size(), false);
+    std::deque<size_t> queue;
+
+    for (size_t i=0; i < edges.size(); ++i) {
+        const Manifest::Edge& edge = edges[i];
+        if (edge.rule == "phony" || edge.outputs.empty())
+            continue;
+
+        auto old = before.find(edge.outputs.front());
+        if (old == before.cend() || old->second != now.at(edge.outputs.front())) {
+            dirty[i] = true;
+            queue.push_back(i);
+        }
+    }
+
+    /*
+     * Anything consuming a dirty output gets rebuilt too. Phony edges pass it
+     * along; order-only dependencies do not.
+     */
+
+    while (!queue.empty()) {
+        const Manifest::Edge& edge = edges[queue.front()];
+        queue.pop_front();
+
+        Manifest::list outs = edge.outputs;
+        outs.insert(outs.end(), edge.implicitOutputs.begin(), edge.implicitOutputs.end());
+
+        for (const string& out : outs) {
+            for (const Manifest::Edge* consumer : after.consumers(out, false)) {
+                size_t j = after.index(*consumer);
+                if (!dirty[j]) {
+                    dirty[j] = true;
+                    queue.push_back(j);
+                }
+            }
+        }
+    }
+
+    /* project -> kind -> { dirty, total } */
+    std::map<string, std::map<string, std::pair<size_t, size_t>>> table;
+    std::map<string, std::pair<size_t, size_t>> totals;
+
+    for (size_t i=0; i < edges.size(); ++i) {
+        string kind = Manifest::kind(edges[i].rule);
+        auto& cell = table[after.project(edges[i])][kind];
+        auto& total = totals[kind];
+
+        cell.second++;
+        total.second++;
+        if (dirty[i]) {
+            cell.first++;
+            total.first++;
+        }
+    }
+
+    size_t count = 0;
+
+    os << "blast radius:";
+    for (const char* kind : kinds) {
+        os << ' ' << totals[kind].first << '/' << totals[kind].second << ' ' << kind;
+        count += totals[kind].first;
+    }
+    os << " edges invalidated" << endl;
+
+    os << std::left << setw(32) << "project";
+    for (const char* kind : kinds)
+        os << setw(12) << kind;
+    os << endl;
+
+    for (auto& row : table) {
+        size_t edgesInRow = 0;
+        for (const char* kind : kinds)
+            edgesInRow += row.second[kind].second;
+        if (edgesInRow == 0)
+            continue;
+
+        os << std::left << setw(32) << row.first;
+        for (const char* kind : kinds) {
+            auto& cell = row.second[kind];
+            os << setw(12) << (std::to_string(cell.first) + "/" + std::to_string(cell.second));
+        }
+        os << endl;
+    }
+
+    return count;
+}
@@ -0,0 +1,56 @@
+#ifndef NGEN_BLAST__HPP
+#define NGEN_BLAST__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Regeneration blast radius: what a new build.ninja will make ninja rebuild.
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+
+class Manifest;
+
+/** Hash of each edge's expanded command, keyed by its first output.
+ */
+using CommandHashes = std::map<std::string, std::string>;
+
+/** Returns the CommandHashes for every non-phony edge in manifest.
+ */
+CommandHashes commandHashes(const Manifest& manifest);
+
+/** Load a file written by saveCommandHashes().
+ *
+ * @returns false if path cannot be read.
+ */
+bool loadCommandHashes(const std::string& path, CommandHashes& hashes);
+
+/** Save hashes as "hash output" lines.
+ */
+bool saveCommandHashes(const std::string& path, const CommandHashes& hashes);
+
+/** Report the edges of after that are invalidated relative to before.
+ *
+ * An edge is invalidated if its command changed, it is new, or it consumes
+ * the output of an invalidated edge. Counts are printed per project.
+ *
+ * @returns the number of compile, link, and install edges invalidated.
+ */
+size_t reportBlastRadius(std::ostream& os, const CommandHashes& before, const Manifest& after);
+
+#endif // NGEN_BLAST__HPP
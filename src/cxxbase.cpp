@@ -18,13 +18,23 @@
 
 #include "Bundle.hpp"
 #include "Statement.hpp"
+#include "filesystem.hpp"
+#include "modules.hpp"
 #include "path.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+
 using std::endl;
 
 cxxbase::cxxbase(Bundle& bundle)
     : Shinobi(bundle)
+    , mUnits()
+    , mHaveUnits(false)
 {
 }
 
@@ -54,6 +64,86 @@ bool cxxbase::generateVariables(const json& project)
         << endl
         ;
 
+    if (has(project, "pch") && precompiledHeaderExtension().empty()) {
+        warning() << n << " backend does not support pch; ignoring it." << endl;
+    }
+
+    /*
+     * A library's signature is known before its dependents are generated.
+     */
+    json settings = precompiledHeaderSettings(project);
+    if (has(settings, "export") && settings.at("export").get<bool>())
+        (*bundle().precompiledHeaders)[targetName()] = precompiledHeaderSignature(project);
+
+    if (has(settings, "use") && !precompiledHeaderExtension().empty() && !usesPrecompiledHeader(project)) {
+        string library = settings.at("use");
+        warning() << library << " precompiles its header with \"" << bundle().precompiledHeaders->at(library)
+            << "\" but " << projectName() << " compiles with \"" << precompiledHeaderSignature(project)
+            << "\"; the compiler would ignore it, so not using it." << endl;
+    }
+
+    string pch = precompiledHeader(project);
+    if (!pch.empty()) {
+        output()
+            << "# flags for compiling with a precompiled header." << endl
+            << "pchflags = " << precompiledHeaderFlags(pch) << endl
+            << endl
+            ;
+    }
+
+    if (usesModules(project) && moduleFlags("").empty()) {
+        warning() << n << " backend does not support C++ modules; ignoring them." << endl;
+    }
+
+    bool wantRestat = bundle().restatObjects || (has(project, "restat_objects") && project.at("restat_objects").get<bool>());
+    if (wantRestat && !supportsRestatObjects()) {
+        warning() << n << " backend does not support restat_objects; ignoring it." << endl;
+    }
+
+    if (!bundle().distribute.empty() && !supportsDistribution()) {
+        warning() << n << " backend does not support --distribute; compiling here." << endl;
+    }
+
+    if (buildsModules(project) || restatObjects(project) || writesSources(project)) {
+        output()
+            << "# helps build.ninja with modules, restat_objects, and generated sources." << endl
+            << "ngen = " << bundle().self << endl
+            << endl
+            ;
+    }
+
+    if (buildsModules(project)) {
+        if (has(project, "unity"))
+            warning() << "unity builds and modules don't mix; ignoring unity." << endl;
+
+        output()
+            << "# flags for compiling with C++ modules." << endl
+            << "moduleflags = " << moduleFlags("$builddir/modules.map") << endl
+            << endl
+            ;
+    }
+
+    return true;
+}
+
+
+bool cxxbase::generateRules()
+{
+    if (!Shinobi::generateRules())
+        return false;
+
+    if (!writesSources(projectData()))
+        return true;
+
+    output()
+        << "# write $out to #include each of $in" << endl
+        << "rule include_file" << endl
+        << "    description = GEN $out" << endl
+        << "    restat = true" << endl
+        << "    command = $ngen --include-file $out $in" << endl
+        << endl
+        ;
+
     return true;
 }
 
@@ -68,24 +158,93 @@ bool cxxbase::generateBuildStatementsForObjects(const json& project, const strin
      * If we have deps, add them here. So a dependencies entry for 'some other
      * project' is a req for compiling our objects. Otherwise headers might not
      * be installed. Etc.
+     *
+     * Only their headers: waiting for their links too would hold up every
+     * compile here until the whole stack below has linked.
      */
 
-    auto deps = json::array({});
+    list deps;
     if (has(project, "dependencies")) {
-        deps = project.at("dependencies");
+        deps = headersReady(project.at("dependencies"));
     }
 
+    /*
+     * The precompiled header is compiled with the same flags as the objects,
+     * so it goes first and they depend on it. If it's another project's,
+     * that project makes it.
+     */
+
+    string pch = precompiledHeader(project);
+    json settings = precompiledHeaderSettings(project);
 
-    for (const string& source : project.at("sources")) {
-        Statement build(rule);
+    if (!pch.empty() && has(settings, "header")) {
+        Statement wrapper("include_file");
+
+        wrapper
+            .appendInput(sourcedir(settings.at("header")))
+            .appendOutput(pch)
+            ;
+
+        output() << wrapper << endl;
+
+        Statement build(rule.substr(0, rule.rfind("_compile")) + "_pch");
 
-        build.appendInput(sourcedir(source));
-        build.appendOutput(object(source));
+        build.appendInput(pch);
+        build.appendOutput(pch + precompiledHeaderExtension());
         build.appendOrderOnlyDependencies(deps);
 
         output() << build << endl;
     }
 
+
+    bool modules = buildsModules(project);
+    if (modules)
+        generateBuildStatementsForModules(compileUnits(project), deps);
+
+    string compile = restatObjects(project) ? rule + "_restat" : rule;
+
+    for (const CompileUnit& unit : compileUnits(project)) {
+        if (unit.members.size() < 2)
+            continue;
+
+        Statement unity("include_file");
+        for (const string& source : unit.members)
+            unity.appendInput(sourcedir(source));
+        unity.appendOutput(unit.input);
+
+        output() << unity << endl;
+    }
+
+    for (const CompileUnit& unit : scheduled(compileUnits(project))) {
+        Statement build(compile);
+
+        build.appendInput(unit.input);
+        build.appendOutput(unit.object);
+        if (!pch.empty())
+            build.appendDependency(pch + precompiledHeaderExtension());
+        build.appendOrderOnlyDependencies(deps);
+        if (modules) {
+            build.appendOrderOnlyDependency("$builddir/modules.dd");
+            build.appendVariable("dyndep", "$builddir/modules.dd");
+        }
+        /*
+         * A heavy compile is only heavy for the worker that gets it. What a
+         * compile was measured taking beats what it was guessed to.
+         */
+        const UsageLog::Entry* usage = bundle().usage ? bundle().usage->find(resolve(unit.object)) : nullptr;
+        if (distributes(project)) {
+            build.appendVariable("pool", "distcc");
+        } else if (usage != nullptr) {
+            string pool = memoryPool(usage->peakBytes);
+            if (!pool.empty())
+                build.appendVariable("pool", pool);
+        } else if (isHeavy(project, unit)) {
+            build.appendVariable("pool", "heavy");
+        }
+
+        output() << build << endl;
+    }
+
     return true;
 }
 
@@ -96,16 +255,21 @@ bool cxxbase::generateBuildStatementsForApplication(const json& project, const s
         return false;
     }
 
-    Statement build(rule);
+    Statement build(responseFileRule(rule, objects(project)));
 
     build.appendInputs(objects(project));
 
+    if (!linkPool(project).empty())
+        build.appendVariable("pool", linkPool(project));
+
     string base_exe = "$bindir/" + targetName() + applicationExtension();
     string build_exe = builddir(base_exe);
     string install_exe = distdir(base_exe);
 
     build.appendOutput(build_exe);
 
+    appendLinkDependencies(build, project);
+
     output() << build << endl;
 
     return true;
@@ -118,22 +282,40 @@ bool cxxbase::generateBuildStatementsForLibrary(const json& project, const strin
         return false;
     }
 
-    Statement build(rule);
+    if (buildsSharedLibrary(project, type)) {
+        Statement build(responseFileRule(rule, objects(project)));
 
-    build.appendInputs(objects(project));
+        build.appendInputs(objects(project));
 
-    string base_lib = libraryBase();
-    string build_lib = builddir(base_lib);
+        string base_lib = libraryBase();
+        string build_lib = builddir(base_lib);
 
-    build.appendOutput(build_lib);
+        build.appendOutput(build_lib);
 
-    build.appendImplicitOutputs(implicitOutputsForLibrary(project, type, rule));
+        build.appendImplicitOutputs(implicitOutputsForLibrary(project, type, rule));
 
-    if (has(project, "dependencies")) {
-        build.appendDependencies(project.at("dependencies"));
+        appendLinkDependencies(build, project);
+
+        if (!linkPool(project).empty())
+            build.appendVariable("pool", linkPool(project));
+
+        output() << build << endl;
     }
 
-    output() << build << endl;
+    /*
+     * c_static_library, cxx_static_library: the rule for cxx_library with
+     * static set is the same as for cxx_static_library.
+     */
+    if (buildsStaticLibrary(project, type)) {
+        Statement archive(responseFileRule(type.substr(0, type.find('_')) + "_static_library", objects(project)));
+
+        archive.appendInputs(objects(project));
+        archive.appendOutput(builddir(staticLibraryBase()));
+
+        output() << archive << endl;
+    }
+
+    registerLinkArtifact(project, type);
 
     return true;
 }
@@ -145,7 +327,8 @@ bool cxxbase::generateBuildStatementsForInstall(const json& project, const strin
         return false;
     }
 
-    Statement install("install");
+    string rule_install = installRule(project);
+    Statement install(rule_install);
 
     if (isApplicationType(type)) {
         string base_exe = "$bindir/" + targetName() + applicationExtension();
@@ -155,35 +338,101 @@ bool cxxbase::generateBuildStatementsForInstall(const json& project, const strin
             .appendInput(build_exe)
             .appendOutput(install_exe)
             ;
+        if (rule_install != "install") {
+            for (const string& ext : debugExtensions(project))
+                install.appendImplicitOutput(install_exe + ext);
+        }
     } else if (isLibraryType(type)) {
-        string base_lib = libraryBase();
-        string build_lib = builddir(base_lib);
-        string dist_lib = distdir(base_lib);
-        install
-            .appendInput(build_lib)
-            .appendOutput(dist_lib)
-            ;
+        if (buildsSharedLibrary(project, type)) {
+            string base_lib = libraryBase();
+            string build_lib = builddir(base_lib);
+            string dist_lib = distdir(base_lib);
+            install
+                .appendInput(build_lib)
+                .appendOutput(dist_lib)
+                ;
+            if (rule_install != "install") {
+                for (const string& ext : debugExtensions(project))
+                    install.appendImplicitOutput(dist_lib + ext);
+            }
+        }
+
+        /*
+         * The archive in builddir may only refer to the objects, so it is
+         * archived again for distdir rather than copied.
+         */
+        if (buildsStaticLibrary(project, type)) {
+            Statement install_archive(responseFileRule("install_archive", objects(project)));
+
+            install_archive
+                .appendInputs(objects(project))
+                .appendOutput(distdir(staticLibraryBase()))
+                ;
 
-        for (const string& hdr : headers()) {
-            string out = header(hdr);
+            output() << install_archive << endl;
+        }
 
-            /*
-             * rule install = copy and set executable.
-             * rule copy = just copy it.
-             */
-            Statement install_header("copy");
+        /*
+         * One process for the lot, or a copy each.
+         */
+        list hdrs = headers();
+        list installed;
+        for (const string& hdr : hdrs)
+            installed.push_back(header(hdr));
+
+        if (bundle().bulkInstall && !hdrs.empty()) {
+            generateBulkInstall("$builddir/headers.stamp", hdrs, installed);
+        } else {
+            for (size_t i=0; i < hdrs.size(); ++i) {
+                /*
+                 * rule install = copy and set executable.
+                 * rule copy = just copy it.
+                 */
+                Statement install_header("copy");
+
+                install_header
+                    .appendInput(hdrs.at(i))
+                    .appendOutput(installed.at(i))
+                    ;
+
+                output() << install_header << endl;
+            }
+        }
 
-            install_header
-                .appendInput(hdr)
+        /*
+         * The exported wrapper includes the installed header, relative to
+         * it, so $distdir can move. GCC only reads it when the .gch next to
+         * it won't do.
+         */
+        json settings = precompiledHeaderSettings(project);
+        if (has(settings, "export") && settings.at("export").get<bool>()) {
+            string pch = precompiledHeader(project);
+            string out = exportedPrecompiledHeader(targetName());
+            string source = sourcedir(settings.at("header"));
+
+            auto it = std::find(hdrs.cbegin(), hdrs.cend(), source);
+            Statement wrapper("include_file");
+
+            wrapper
+                .appendInput(it == hdrs.cend() ? source : installed.at(it - hdrs.cbegin()))
                 .appendOutput(out)
                 ;
 
-            output() << install_header << endl;
-        }
+            output() << wrapper << endl;
+
+            Statement install_pch("copy");
+
+            install_pch
+                .appendInput(pch + precompiledHeaderExtension())
+                .appendOutput(out + precompiledHeaderExtension())
+                ;
 
+            output() << install_pch << endl;
+        }
     }
 
-    output() << install << endl;
+    if (!isLibraryType(type) || buildsSharedLibrary(project, type))
+        output() << install << endl;
 
 
 
@@ -207,11 +456,11 @@ bool cxxbase::generateBuildStatementsForTargetName(const json& project, const st
             .appendOutput(sourcedir(""))
             ;
     } else if (isLibraryType(type)) {
-        string dist_lib = distdir(libraryBase());
-        all
-            .appendInput(dist_lib)
-            .appendOutput(targetName())
-            ;
+        if (buildsSharedLibrary(project, type))
+            all.appendInput(distdir(libraryBase()));
+        if (buildsStaticLibrary(project, type))
+            all.appendInput(distdir(staticLibraryBase()));
+        all.appendOutput(targetName());
     }
     all.appendInputs(extraInputsForTargetName(project, type, rule));
 
@@ -222,6 +471,34 @@ bool cxxbase::generateBuildStatementsForTargetName(const json& project, const st
 }
 
 
+bool cxxbase::generateBuildStatementsForHeadersReady(const json& project, const string& type, const string& rule)
+{
+    if (!isSupportedType(type))
+        return false;
+
+    if (!isLibraryType(type))
+        return Shinobi::generateBuildStatementsForHeadersReady(project, type, rule);
+
+    /*
+     * Our headers may include our dependencies', so they have to be there too.
+     */
+
+    Statement ready(rule);
+
+    ready
+        .appendInputs(installedHeaders(project))
+        .appendInputs(Shinobi::extraInputsForTargetName(project, type, rule))
+        .appendOutput(headersReady(targetName()))
+        ;
+    if (has(project, "dependencies"))
+        ready.appendInputs(headersReady(project.at("dependencies")));
+
+    output() << ready << endl;
+
+    return true;
+}
+
+
 bool cxxbase::isSupportedType(const string& type) const
 {
     if (type.find("c_") != 0 && type.find("cxx_") != 0) {
@@ -233,14 +510,94 @@ bool cxxbase::isSupportedType(const string& type) const
 }
 
 
+void cxxbase::generateRuleWithResponseFile(const string& comment, const string& name, const string& description,
+                                           const string& pool, const string& command)
+{
+    static const char* indent = "    ";
+
+    /*
+     * $in, but not $in_newline.
+     */
+    auto replaceIn = [](string text, const string& with) {
+        for (size_t i = text.find("$in"); i != string::npos; i = text.find("$in", i)) {
+            if (i + 3 < text.size() && (std::isalnum(text[i + 3]) || text[i + 3] == '_')) {
+                i += 3;
+                continue;
+            }
+            text.replace(i, 3, with);
+            i += with.size();
+        }
+        return text;
+    };
+
+    output()
+        << "# " << comment << endl
+        << "rule " << name << endl
+        << indent << "description = " << description << endl
+        ;
+    if (!pool.empty())
+        output() << indent << "pool = " << pool << endl;
+    output()
+        << indent << "command = " << command << endl
+        << endl
+        ;
+
+    output()
+        << "# " << comment << ", with $in in a response file" << endl
+        << "rule " << name << "_rsp" << endl
+        << indent << "description = " << replaceIn(description, "$out.rsp") << endl
+        ;
+    if (!pool.empty())
+        output() << indent << "pool = " << pool << endl;
+    output()
+        << indent << "rspfile = $out.rsp" << endl
+        << indent << "rspfile_content = $in" << endl
+        << indent << "command = " << replaceIn(command, "@$out.rsp") << endl
+        << endl
+        ;
+}
+
+
+cxxbase::string cxxbase::responseFileRule(const string& rule, const list& inputs) const
+{
+    long threshold = bundle().responseFileThreshold;
+
+    if (threshold < 0 || inputs.size() <= static_cast<size_t>(threshold))
+        return rule;
+
+    return rule + "_rsp";
+}
+
+
+bool cxxbase::isStaticLibraryType(const string& type) const
+{
+    return type.rfind("_static_library") != string::npos;
+}
+
+
+bool cxxbase::buildsSharedLibrary(const json& project, const string& type) const
+{
+    (void)project;
+    return isLibraryType(type) && !isStaticLibraryType(type);
+}
+
+
+bool cxxbase::buildsStaticLibrary(const json& project, const string& type) const
+{
+    if (isStaticLibraryType(type))
+        return true;
+
+    return isLibraryType(type) && has(project, "static") && project.at("static").get<bool>();
+}
+
+
 cxxbase::list cxxbase::extraInputsForTargetName(const json& project, const string& type, const string& rule)
 {
     list r = Shinobi::extraInputsForTargetName(project, type, rule);
 
     if (isLibraryType(type)) {
-        for (const string& in : headers()) {
-            r.push_back(header(in));
-        }
+        for (const string& in : installedHeaders(project))
+            r.push_back(in);
     }
 
     return r;
@@ -253,18 +610,474 @@ cxxbase::string cxxbase::object(const string& source) const
 }
 
 
-cxxbase::list cxxbase::objects(const json& project) const
+bool cxxbase::isHeavy(const json& project, const CompileUnit& unit) const
 {
-    cxxbase::list objs;
+    if (!has(project, "heavy"))
+        return false;
+
+    const json& heavy = project.at("heavy");
+
+    if (heavy.is_boolean())
+        return heavy.get<bool>();
+
+    for (const string& source : heavy) {
+        if (std::find(unit.members.cbegin(), unit.members.cend(), source) != unit.members.cend())
+            return true;
+    }
+
+    return false;
+}
+
+
+cxxbase::string cxxbase::linkPool(const json& project) const
+{
+    (void)project;
+    return "";
+}
+
+
+cxxbase::string cxxbase::linkArtifact(const json& project, const string& type) const
+{
+    if (buildsSharedLibrary(project, type))
+        return builddir(libraryBase());
+
+    return builddir(staticLibraryBase());
+}
+
+
+void cxxbase::appendLinkDependencies(Statement& link, const json& project) const
+{
+    if (!has(project, "dependencies"))
+        return;
+
+    list dirs;
+
+    for (const string& name : project.at("dependencies")) {
+        string artifact;
+        if (bundle().artifacts && bundle().artifacts->count(name) > 0)
+            artifact = bundle().artifacts->at(name);
+
+        if (artifact.empty()) {
+            link.appendDependency(name);
+            continue;
+        }
+
+        link.appendDependency(artifact);
+
+        string dir = artifact.substr(0, artifact.rfind('/'));
+        if (std::find(dirs.cbegin(), dirs.cend(), dir) == dirs.cend())
+            dirs.push_back(dir);
+    }
+
+    if (!dirs.empty())
+        link.appendVariable("ldflags", librarySearchFlags(dirs));
+}
+
+
+void cxxbase::registerLinkArtifact(const json& project, const string& type) const
+{
+    /*
+     * $builddir is ours alone, the rest of the path is the same everywhere.
+     */
+    if (bundle().artifacts)
+        (*bundle().artifacts)[targetName()] = resolve(linkArtifact(project, type));
+}
+
+
+cxxbase::string cxxbase::installRule(const json& project) const
+{
+    (void)project;
+    return "install";
+}
+
+
+cxxbase::string cxxbase::debugExtension() const
+{
+    return "";
+}
+
+
+cxxbase::list cxxbase::debugExtensions(const json& project) const
+{
+    (void)project;
+    return { debugExtension() };
+}
+
+
+cxxbase::string cxxbase::precompiledHeaderExtension() const
+{
+    return "";
+}
+
+
+cxxbase::string cxxbase::precompiledHeaderFlags(const string& header) const
+{
+    (void)header;
+    return "";
+}
+
+
+cxxbase::string cxxbase::precompiledHeaderSignature(const json& project) const
+{
+    (void)project;
+    return "";
+}
+
+
+bool cxxbase::supportsRestatObjects() const
+{
+    return false;
+}
+
+
+bool cxxbase::restatObjects(const json& project) const
+{
+    if (!supportsRestatObjects())
+        return false;
+    if (bundle().restatObjects)
+        return true;
+
+    return has(project, "restat_objects") && project.at("restat_objects").get<bool>();
+}
+
+
+bool cxxbase::supportsDistribution() const
+{
+    return false;
+}
+
+
+bool cxxbase::distributes(const json& project) const
+{
+    return supportsDistribution() && !bundle().distribute.empty() && !buildsModules(project);
+}
+
+
+cxxbase::string cxxbase::moduleFlags(const string& mapper) const
+{
+    (void)mapper;
+    return "";
+}
+
+
+bool cxxbase::usesModules(const json& project) const
+{
+    if (project.at("type").get<string>().compare(0, 4, "cxx_") != 0)
+        return false;
+
+    if (has(project, "modules"))
+        return project.at("modules").get<bool>();
 
     for (const string& source : project.at("sources")) {
-        objs.push_back(object(source));
+        if (isModuleInterface(source))
+            return true;
+    }
+
+    return false;
+}
+
+
+bool cxxbase::buildsModules(const json& project) const
+{
+    return usesModules(project) && !moduleFlags("").empty();
+}
+
+
+void cxxbase::generateBuildStatementsForModules(const std::vector<CompileUnit>& units, const list& deps)
+{
+    /*
+     * What a unit imports isn't known until it's preprocessed, so each is
+     * scanned for its P1689 module info. The collator turns those into a
+     * dyndep file that orders the compiles, so a module's BMI is built
+     * before anything importing it. The collator only rewrites what changed,
+     * so restat saves the compiles when an edit doesn't touch any imports.
+     */
+
+    list ddis;
+
+    for (const CompileUnit& unit : units) {
+        Statement scan("cxx_scan");
+        string ddi = unit.object.substr(0, unit.object.size() - objectExtension().size()) + ".ddi";
+
+        scan.appendInput(unit.input);
+        scan.appendOutput(ddi);
+        scan.appendOrderOnlyDependencies(deps);
+        scan.appendVariable("obj", unit.object);
+
+        output() << scan << endl;
+        ddis.push_back(ddi);
+    }
+
+    Statement collate("cxx_collate");
+
+    collate.appendInputs(ddis);
+    collate.appendOutput("$builddir/modules.dd");
+    collate.appendImplicitOutput("$builddir/modules.map");
+    collate.appendVariable("gcmdir", "$builddir/gcm");
+
+    output() << collate << endl;
+}
+
+
+cxxbase::string cxxbase::precompiledHeader(const json& project) const
+{
+    json settings = precompiledHeaderSettings(project);
+
+    if (settings.is_null() || precompiledHeaderExtension().empty())
+        return "";
+
+    if (has(settings, "use"))
+        return usesPrecompiledHeader(project) ? exportedPrecompiledHeader(settings.at("use")) : "";
+
+    if (has(settings, "header"))
+        return builddir("pch/" + targetName() + ".h");
+
+    warning() << "pch needs a header or use entry; ignoring it." << endl;
+    return "";
+}
+
+
+bool cxxbase::usesPrecompiledHeader(const json& project) const
+{
+    string library = precompiledHeaderSettings(project).at("use");
+    auto theirs = bundle().precompiledHeaders->find(library);
+
+    /*
+     * Not generated here, e.g. restored from the artifact cache: the
+     * compiler has -Winvalid-pch to tell.
+     */
+    if (theirs == bundle().precompiledHeaders->cend())
+        return true;
+
+    return theirs->second == precompiledHeaderSignature(project);
+}
+
+
+cxxbase::string cxxbase::exportedPrecompiledHeader(const string& library) const
+{
+    return distdir("$includedir/pch/" + library + ".h");
+}
+
+
+cxxbase::json cxxbase::precompiledHeaderSettings(const json& project)
+{
+    if (!has(project, "pch"))
+        return nullptr;
+
+    const json& pch = project.at("pch");
+
+    if (pch.is_string())
+        return json{ { "header", pch } };
+
+    return pch;
+}
+
+
+bool cxxbase::writesSources(const json& project) const
+{
+    if (has(project, "unity") && !buildsModules(project))
+        return true;
+
+    return !precompiledHeaderExtension().empty() && has(precompiledHeaderSettings(project), "header");
+}
+
+
+cxxbase::list cxxbase::objects(const json& project)
+{
+    cxxbase::list objs;
+
+    for (const CompileUnit& unit : compileUnits(project)) {
+        objs.push_back(unit.object);
     }
 
     return objs;
 }
 
 
+const std::vector<cxxbase::CompileUnit>& cxxbase::compileUnits(const json& project)
+{
+    if (mHaveUnits)
+        return mUnits;
+    mHaveUnits = true;
+
+    if (!has(project, "unity") || buildsModules(project)) {
+        for (const string& source : project.at("sources")) {
+            mUnits.push_back(CompileUnit{ sourcedir(source), object(source), { source } });
+        }
+        return mUnits;
+    }
+
+    /*
+     * The unity sources live in $builddir/unity, written by include_file so
+     * they come back when the build directory doesn't.
+     */
+
+    size_t n = 0;
+    for (const list& batch : unityBatches(project)) {
+        if (batch.size() == 1) {
+            const string& source = batch.front();
+            mUnits.push_back(CompileUnit{ sourcedir(source), object(source), batch });
+            continue;
+        }
+
+        string base = "unity/unity_" + std::to_string(n++);
+        string name = base + extension(batch.front());
+
+        mUnits.push_back(CompileUnit{ builddir(name), builddir(base + objectExtension()), batch });
+    }
+
+    return mUnits;
+}
+
+
+std::vector<cxxbase::CompileUnit> cxxbase::scheduled(const std::vector<CompileUnit>& units) const
+{
+    std::vector<CompileUnit> r = units;
+
+    if (!bundle().longestFirst)
+        return r;
+
+    /*
+     * Cost is { ms last build, bytes }. Units without a recorded time are
+     * guessed at as an average one of this project, so with no history at
+     * all it comes down to file size.
+     */
+
+    const NinjaLog* history = bundle().history.get();
+    std::map<string, std::pair<long, uintmax_t>> cost;
+    long known = 0;
+    long total = 0;
+
+    for (const CompileUnit& unit : r) {
+        long ms = history == nullptr ? -1 : history->duration(resolve(unit.object), -1);
+        if (ms >= 0) {
+            known++;
+            total += ms;
+        }
+
+        uintmax_t bytes = 0;
+        for (const string& source : unit.members)
+            bytes += fileSize(bundle().sourcedir + "/" + source);
+
+        cost[unit.object] = { ms, bytes };
+    }
+
+    long mean = known == 0 ? 0 : total / known;
+    for (auto& pair : cost) {
+        if (pair.second.first < 0)
+            pair.second.first = mean;
+    }
+
+    std::stable_sort(r.begin(), r.end(), [&cost](const CompileUnit& a, const CompileUnit& b) {
+        return cost[a.object] > cost[b.object];
+    });
+
+    return r;
+}
+
+
+std::vector<cxxbase::list> cxxbase::unityBatches(const json& project) const
+{
+    const json& unity = project.at("unity");
+    const json& sources = project.at("sources");
+
+    string saved = bundle().builddir + "/unity/batches.json";
+    string key = hex(fnv1a(sources.dump() + unity.dump()));
+
+    std::ifstream in(saved);
+    if (in) {
+        try {
+            json previous = json::parse(in);
+            if (previous.at("key") == key)
+                return previous.at("batches").get<std::vector<list>>();
+        } catch (std::exception& ex) {
+            warning() << "ignoring " << saved << ": " << ex.what() << endl;
+        }
+    }
+
+    std::vector<list> batches;
+    list members;
+
+    for (const string& source : sources) {
+        bool excluded = false;
+
+        if (has(unity, "exclude")) {
+            for (const string& pattern : unity.at("exclude"))
+                excluded = excluded || globMatch(pattern, source);
+        }
+
+        if (excluded)
+            batches.push_back({ source });
+        else
+            members.push_back(source);
+    }
+
+    /*
+     * Either a count of sources per batch, or a byte budget.
+     */
+
+    size_t count = 0;
+    uintmax_t budget = 0;
+
+    if (has(unity, "batches")) {
+        size_t n = std::max<size_t>(1, unity.at("batches").get<size_t>());
+        count = (members.size() + n - 1) / n;
+    } else if (has(unity, "batch_size")) {
+        count = std::max<size_t>(1, unity.at("batch_size").get<size_t>());
+    } else if (has(unity, "max_bytes")) {
+        budget = unity.at("max_bytes").get<uintmax_t>();
+    } else {
+        count = 8;
+    }
+
+    list batch;
+    uintmax_t bytes = 0;
+
+    for (const string& source : members) {
+        uintmax_t size = fileSize(bundle().sourcedir + "/" + source);
+        bool full = count > 0 ? batch.size() >= count : bytes + size > budget;
+
+        if (!batch.empty() && full) {
+            batches.push_back(batch);
+            batch.clear();
+            bytes = 0;
+        }
+
+        batch.push_back(source);
+        bytes += size;
+    }
+    if (!batch.empty())
+        batches.push_back(batch);
+
+    std::error_code ec;
+    std::filesystem::create_directories(bundle().builddir + "/unity", ec);
+    writeIfChanged(saved, json{ { "key", key }, { "batches", batches } }.dump(4) + "\n");
+
+    return batches;
+}
+
+
+bool cxxbase::writeIfChanged(const string& path, const string& content) const
+{
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        std::ostringstream old;
+        old << in.rdbuf();
+        if (old.str() == content)
+            return true;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error() << "cannot create " << path << endl;
+        return false;
+    }
+    out << content;
+
+    return static_cast<bool>(out);
+}
+
+
 cxxbase::string cxxbase::executableBase() const
 {
     return "$bindir/" + targetName() + applicationExtension();
@@ -287,6 +1100,21 @@ cxxbase::string cxxbase::libraryBase() const
 }
 
 
+cxxbase::string cxxbase::staticLibraryBase() const
+{
+    string base = "$archive/";
+
+    if (targetName().find(staticLibraryPrefix()) != 0)
+        base.append(staticLibraryPrefix());
+
+    base.append(targetName())
+        .append(staticLibraryExtension())
+        ;
+
+    return base;
+}
+
+
 cxxbase::list cxxbase::headers() const
 {
     const json& project = projectData();
@@ -322,6 +1150,24 @@ cxxbase::list cxxbase::headers() const
 }
 
 
+cxxbase::list cxxbase::installedHeaders(const json& project) const
+{
+    list r;
+
+    for (const string& in : headers()) {
+        r.push_back(header(in));
+    }
+
+    json settings = precompiledHeaderSettings(project);
+    if (has(settings, "export") && settings.at("export").get<bool>()) {
+        r.push_back(exportedPrecompiledHeader(targetName()));
+        r.push_back(exportedPrecompiledHeader(targetName()) + precompiledHeaderExtension());
+    }
+
+    return r;
+}
+
+
 cxxbase::string cxxbase::header(const string& hdr) const
 {
     const json& project = projectData();
@@ -17,6 +17,7 @@
  */
 
 #include "Shinobi.hpp"
+#include "Statement.hpp"
 #include <utility>
 
 /* Ninja generator - C/C++ base class.
@@ -28,30 +29,243 @@ class cxxbase : public Shinobi
     cxxbase(Bundle& bundle);
 
     bool generateVariables(const json& project) override;
+    bool generateRules() override;
     bool generateBuildStatementsForObjects(const json& project, const string& type, const string& rule) override;
     bool generateBuildStatementsForApplication(const json& project, const string& type, const string& rule) override;
     bool generateBuildStatementsForLibrary(const json& project, const string& type, const string& rule) override;
     bool generateBuildStatementsForInstall(const json& project, const string& type, const string& rule) override;
     bool generateBuildStatementsForTargetName(const json& project, const string& type, const string& rule) override;
+    bool generateBuildStatementsForHeadersReady(const json& project, const string& type, const string& rule) override;
 
   protected:
 
+    /** A translation unit to compile, and the object it makes.
+     */
+    struct CompileUnit
+    {
+        /** $sourcedir/foo.cpp, or a generated unity source in $builddir. */
+        string input;
+        string object;
+        /** The /project/sources compiled by this unit. */
+        list members;
+    };
+
     bool isSupportedType(const string& type) const;
 
+    /** Generate rule name, and name_rsp that passes $in in a response file.
+     *
+     * Links and archives with more inputs than the command line takes (or
+     * than is cheap to hash and log) use the latter; see responseFileRule().
+     *
+     * @param command uses $in where the inputs go.
+     * @param pool to put the edges in, or "".
+     */
+    void generateRuleWithResponseFile(const string& comment, const string& name, const string& description,
+                                      const string& pool, const string& command);
+
+    /** Returns rule, or its _rsp form if inputs are over the bundle's
+     * responseFileThreshold.
+     */
+    string responseFileRule(const string& rule, const list& inputs) const;
+
     list extraInputsForTargetName(const json& project, const string& type, const string& rule) override;
 
     virtual string objectExtension() const = 0;
     virtual string applicationExtension() const = 0;
     virtual string libraryPrefix() const = 0;
     virtual string libraryExtension() const = 0;
+    virtual string staticLibraryPrefix() const = 0;
+    virtual string staticLibraryExtension() const = 0;
+
+    /** Returns if type is c_static_library or cxx_static_library.
+     */
+    bool isStaticLibraryType(const string& type) const;
+
+    /** Returns if project links a shared library.
+     */
+    bool buildsSharedLibrary(const json& project, const string& type) const;
+
+    /** Returns if project archives a static library.
+     *
+     * That's the *_static_library types, and shared libraries with
+     * /project/static set to true. The latter archive the same objects
+     * they link, so they're only compiled once.
+     */
+    bool buildsStaticLibrary(const json& project, const string& type) const;
+
+    /** Returns the pool to link project in, or "" for the rule's.
+     */
+    virtual string linkPool(const json& project) const;
+
+    /** Returns what dependents link with, in $builddir.
+     *
+     * Normally that's the shared library, or the archive when there's no
+     * shared library.
+     */
+    virtual string linkArtifact(const json& project, const string& type) const;
+
+    /** Returns the ldflags to link with libraries in dirs ahead of any
+     * installed copies.
+     */
+    virtual string librarySearchFlags(const list& dirs) const = 0;
+
+    /** Make link depend on /project/dependencies.
+     *
+     * Those that have registered a linkArtifact() are linked with their copy
+     * in builddir, so the link doesn't wait for them to be installed.
+     * Others, e.g. external projects, are depended on by name.
+     */
+    void appendLinkDependencies(Statement& link, const json& project) const;
+
+    /** Record linkArtifact() in the bundle's artifacts for dependents.
+     */
+    void registerLinkArtifact(const json& project, const string& type) const;
+
+    /** Returns the rule to install project's application or library with.
+     *
+     * A rule other than "install" also makes the installed file's
+     * debugExtensions() files.
+     */
+    virtual string installRule(const json& project) const;
+
+    /** Returns the extension of the separate debug info installRule() makes.
+     */
+    virtual string debugExtension() const;
+
+    /** Returns the extensions of every file installRule() makes beside the
+     * installed one: debugExtension(), and any more the debug mode needs.
+     */
+    virtual list debugExtensions(const json& project) const;
+
+    /** Returns the extension the compiler gives precompiled headers.
+     *
+     * Empty when the backend doesn't support /project/pch.
+     */
+    virtual string precompiledHeaderExtension() const;
+
+    /** Returns the flags to compile with header precompiled.
+     */
+    virtual string precompiledHeaderFlags(const string& header) const;
+
+    /** Returns the compiler and flags a precompiled header for project has
+     * to be made with, for a project using it to compile with it.
+     *
+     * Empty when the backend can't tell, and any will do.
+     */
+    virtual string precompiledHeaderSignature(const json& project) const;
+
+    /** Returns if the backend has {rule}_restat compile rules.
+     *
+     * Those compile to a temporary and only replace the object when it
+     * differs, so a change that makes the same object doesn't relink.
+     */
+    virtual bool supportsRestatObjects() const;
+
+    /** Returns if project compiles with the _restat rules.
+     *
+     * That's when /project/restat_objects or the bundle says so, and the
+     * backend supports it.
+     */
+    bool restatObjects(const json& project) const;
+
+    /** Returns if the backend's compiles can go through --distribute.
+     */
+    virtual bool supportsDistribution() const;
+
+    /** Returns if project's compiles go to the distcc pool.
+     *
+     * That's when --distribute is given, the backend supports it, and
+     * project doesn't build modules: those need the mapper and the
+     * .gcm files here.
+     */
+    bool distributes(const json& project) const;
+
+    /** Returns the flags to compile with C++ modules, mapped by mapper.
+     *
+     * Empty when the backend doesn't support /project/modules.
+     */
+    virtual string moduleFlags(const string& mapper) const;
+
+    /** Returns if project is C++ using modules.
+     *
+     * That's when /project/modules is true, or unset and a source has a
+     * module interface extension like .cppm.
+     */
+    bool usesModules(const json& project) const;
+
+    /** Returns if project uses modules, and the backend supports them.
+     */
+    bool buildsModules(const json& project) const;
+
+    /** Generate the edges that scan the units for modules and collate
+     * the results into $builddir/modules.dd for the compiles' dyndep.
+     */
+    void generateBuildStatementsForModules(const std::vector<CompileUnit>& units, const list& deps);
+
+    /** Returns the header /project/pch has this project compile with, or "".
+     *
+     * The pch setting is either the path of a header in $sourcedir, or an
+     * object with one of:
+     *
+     * - "header": the path of a header in $sourcedir. With "export": true a
+     *   library also installs its precompiled header for others to "use".
+     * - "use": the name of a library project that exports one.
+     *
+     * Headers in $sourcedir are compiled through a $builddir/pch/{targetName()}.h
+     * written by include_file, so the compiler has something to fall back on
+     * when it rejects the precompiled one.
+     */
+    string precompiledHeader(const json& project) const;
+
+    /** Returns where a library exports its precompiled header.
+     */
+    string exportedPrecompiledHeader(const string& library) const;
 
     /** foo.cpp -> $builddir/foo.o.
      */
     string object(const string& source) const;
 
-    /** Returns object() over /project/sources.
+    /** Returns the object of each compileUnits().
+     */
+    list objects(const json& project);
+
+    /** Returns what to compile for /project/sources.
+     *
+     * One unit per source, unless there's a /project/unity block. Then the
+     * sources are batched into generated unity sources that #include them;
+     * see unityBatches().
+     */
+    const std::vector<CompileUnit>& compileUnits(const json& project);
+
+    /** Returns units in the order their compiles should be emitted.
+     *
+     * That's as given, unless the bundle asks for longest first. Then it is
+     * by the duration of the last build, or file size if nothing's recorded.
+     */
+    std::vector<CompileUnit> scheduled(const std::vector<CompileUnit>& units) const;
+
+    /** Returns if unit compiles in the heavy pool.
+     *
+     * /project/heavy is true for all of them, or a list of the sources that
+     * need it. A unity batch is heavy if any of its sources are.
      */
-    list objects(const json& project) const;
+    bool isHeavy(const json& project, const CompileUnit& unit) const;
+
+    /** Split /project/sources into batches per /project/unity.
+     *
+     * The unity block takes one of "batches" (how many), "batch_size" (sources
+     * per batch), or "max_bytes" (source bytes per batch), and an "exclude"
+     * list of sources to compile on their own. Those come back as batches of
+     * one.
+     *
+     * Exclude entries are globs; see globMatch().
+     *
+     * The batches are saved in $builddir/unity/batches.json and reused until
+     * sources or the unity block change, so edits to a file don't shuffle
+     * the batches and rebuild the lot. Only ngen reads it: without it, the
+     * next run batches afresh.
+     */
+    std::vector<list> unityBatches(const json& project) const;
 
     /** Returns the base path of the executable.
      *
@@ -65,6 +279,12 @@ class cxxbase : public Shinobi
      */
     string libraryBase() const;
 
+    /** Returns the base path of the static library.
+     *
+     * You'll still need to add builddir() or distdir() qualifications.
+     */
+    string staticLibraryBase() const;
+
     /** Returns list of headers by way of $sourcedir/....
      */
     list headers() const;
@@ -73,8 +293,34 @@ class cxxbase : public Shinobi
      */
     string header(const string& hdr) const;
 
+    /** Returns the headers a library installs for dependents, including an
+     * exported precompiled header.
+     */
+    list installedHeaders(const json& project) const;
+
   private:
-    list mObjects;
+
+    /** Returns if build.ninja writes sources for project with include_file.
+     */
+    bool writesSources(const json& project) const;
+
+    /** Write path unless it already has content. Keeps ninja from seeing a
+     * change when there is none.
+     */
+    bool writeIfChanged(const string& path, const string& content) const;
+
+    /** Returns if project can compile with the precompiled header it "use"s.
+     *
+     * Not when the library made it with another precompiledHeaderSignature().
+     */
+    bool usesPrecompiledHeader(const json& project) const;
+
+    /** Returns /project/pch in its object form, or null.
+     */
+    static json precompiledHeaderSettings(const json& project);
+
+    std::vector<CompileUnit> mUnits;
+    bool mHaveUnits;
 };
 
 #endif // NGEN_CXXBASE__HPP
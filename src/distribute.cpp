@@ -0,0 +1,702 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include "distribute.hpp"
+
+#include "filesystem.hpp"
+#include "path.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_WIN32)
+extern "C" {
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+#endif
+
+namespace fs = std::filesystem;
+using std::endl;
+using std::string;
+using list = std::vector<std::string>;
+
+const char* defaultDistPort = "3633";
+
+static const char* protocol = "ngen-dist 1";
+
+
+bool parseDistHosts(const string& hosts, std::vector<DistHost>& out)
+{
+    string spaced = hosts;
+    std::replace(spaced.begin(), spaced.end(), ',', ' ');
+
+    std::istringstream words(spaced);
+    string word;
+
+    while (words >> word) {
+        DistHost host{ word, defaultDistPort, 4 };
+
+        size_t slash = host.host.find('/');
+        if (slash != string::npos) {
+            host.jobs = std::strtoul(host.host.c_str() + slash + 1, nullptr, 10);
+            host.host.erase(slash);
+            if (host.jobs == 0) {
+                std::clog << "bad jobs for distributed host: " << word << endl;
+                return false;
+            }
+        }
+
+        /*
+         * [::1]:port for IPv6, since the address has colons of its own.
+         */
+        size_t colon = host.host.rfind(':');
+        if (!host.host.empty() && host.host[0] == '[') {
+            size_t bracket = host.host.find(']');
+            if (bracket == string::npos) {
+                std::clog << "bad distributed host: " << word << endl;
+                return false;
+            }
+            if (colon != string::npos && colon > bracket)
+                host.port = host.host.substr(colon + 1);
+            host.host = host.host.substr(1, bracket - 1);
+        } else if (colon != string::npos) {
+            host.port = host.host.substr(colon + 1);
+            host.host.erase(colon);
+        }
+
+        if (host.host.empty() || host.port.empty()) {
+            std::clog << "bad distributed host: " << word << endl;
+            return false;
+        }
+
+        out.push_back(host);
+    }
+
+    if (out.empty()) {
+        std::clog << "no distributed hosts in: " << hosts << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Options that only the preprocessor cares about, and whether they take the
+ * next argument. They stay here.
+ */
+static bool preprocessorOnly(const string& arg, bool& takesValue)
+{
+    static const char* separate[] = {
+        "-o", "-MF", "-MT", "-MQ", "-x", "-include", "-imacros", "-I", "-isystem",
+        "-iquote", "-idirafter", "-iprefix", "-iwithprefix", "-isysroot", "-D", "-U",
+        "-Xpreprocessor",
+    };
+
+    for (const char* option : separate) {
+        if (arg == option) {
+            takesValue = true;
+            return true;
+        }
+    }
+
+    static const char* joined[] = {
+        "-I", "-D", "-U", "-M", "-Wp,", "-isystem", "-iquote", "-idirafter",
+    };
+
+    takesValue = false;
+    for (const char* option : joined) {
+        if (arg.compare(0, std::strlen(option), option) == 0)
+            return true;
+    }
+
+    return arg == "-c";
+}
+
+
+/*
+ * Options that take the next argument after preprocessing. Workers take
+ * no other arguments that don't start with -, so they can't be handed
+ * files to read.
+ */
+static bool takesCompileValue(const string& arg)
+{
+    return arg == "--param" || arg == "-Xassembler";
+}
+
+
+/*
+ * Options that read or write a file of their own, joined or not, which a
+ * worker doesn't have or would throw away. Prefix maps only rename paths.
+ */
+static bool takesPath(const string& arg)
+{
+    if (arg.compare(0, 2, "-f") == 0 && arg.find("-prefix-map=") != string::npos)
+        return false;
+
+    if (arg.find_first_of("/\\") != string::npos)
+        return true;
+
+    static const char* options[] = {
+        "-o", "-M", "-I", "-L", "-i", "-B", "--sysroot", "-Wa,", "-Wl,", "-Wp,",
+        "-Xlinker", "-Xpreprocessor", "-Xclang", "-fplugin", "-specs", "--specs",
+        "-wrapper", "-fdump-", "-fprofile-", "-fauto-profile", "-fopt-info",
+        "-fcallgraph-info", "-fsanitize-blacklist", "-fsanitize-ignorelist",
+        "-fmodule", "-gsplit-dwarf", "-save-temps", "-aux-info", "@",
+    };
+
+    for (const char* option : options) {
+        if (arg.compare(0, std::strlen(option), option) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * What the worker is sent: argv[0] and the compile flags, and the suffix
+ * that tells it the language of the .i. False for anything that has to be
+ * compiled here.
+ */
+static bool remoteCommand(const list& command, list& argv, string& suffix, string& input, string& output)
+{
+    bool compile = false;
+    size_t inputs = 0;
+    string language;
+
+    argv = { filename(command.front()) };
+
+    for (size_t i=1; i < command.size(); ++i) {
+        const string& arg = command[i];
+        bool takesValue;
+
+        if (arg.compare(0, 8, "-fmodule") == 0)
+            return false;
+
+        if (arg == "-c")
+            compile = true;
+
+        if (preprocessorOnly(arg, takesValue)) {
+            if (takesValue && i + 1 < command.size()) {
+                const string& value = command[++i];
+                if (arg == "-o")
+                    output = value;
+                else if (arg == "-x")
+                    language = value;
+            }
+        } else if (takesCompileValue(arg) && i + 1 < command.size()) {
+            if (takesPath(command[i + 1]))
+                return false;
+            argv.push_back(arg);
+            argv.push_back(command[++i]);
+        } else if (arg.empty() || arg[0] == '@') {
+            return false;
+        } else if (arg[0] != '-') {
+            input = arg;
+            ++inputs;
+        } else if (takesPath(arg)) {
+            return false;
+        } else {
+            argv.push_back(arg);
+        }
+    }
+
+    if (!compile || inputs != 1 || output.empty())
+        return false;
+
+    if (language.empty()) {
+        string ext = extension(input);
+        if (ext == ".c")
+            language = "c";
+        else if (ext == ".cc" || ext == ".cp" || ext == ".cxx" || ext == ".cpp" || ext == ".CPP" || ext == ".c++" || ext == ".C")
+            language = "c++";
+    }
+
+    if (language == "c")
+        suffix = ".i";
+    else if (language == "c++")
+        suffix = ".ii";
+    else
+        return false;
+
+    return true;
+}
+
+
+#if !defined(_WIN32)
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+
+static bool sendField(int fd, const string& field)
+{
+    string length = std::to_string(field.size()) + "\n";
+
+    return writeAll(fd, length.data(), length.size()) && writeAll(fd, field.data(), field.size());
+}
+
+
+static bool readField(int fd, string& field)
+{
+    /*
+     * A source with every header pasted in is big, but not this big.
+     */
+    static const size_t maxField = size_t(1) << 30;
+
+    string length;
+    char c;
+
+    for (;;) {
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n != 1)
+            return false;
+        if (c == '\n')
+            break;
+        if (c < '0' || c > '9' || length.size() > 10)
+            return false;
+        length.push_back(c);
+    }
+
+    size_t size = std::strtoull(length.c_str(), nullptr, 10);
+    if (length.empty() || size > maxField)
+        return false;
+
+    field.resize(size);
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, &field[got], size - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+
+    return true;
+}
+
+
+static int connectTo(const DistHost& host)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.host.c_str(), host.port.c_str(), &hints, &addresses) != 0)
+        return -1;
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addresses);
+
+    return fd;
+}
+
+
+/*
+ * Send the compile to host. False if it couldn't be sent or the reply was
+ * cut short; status is the compile's.
+ */
+static bool compileOn(const DistHost& host, const list& argv, const string& suffix, const string& source,
+                      int& status, string& diagnostics, string& object)
+{
+    int fd = connectTo(host);
+    if (fd < 0)
+        return false;
+
+    bool sent = sendField(fd, protocol)
+        && sendField(fd, suffix)
+        && sendField(fd, std::to_string(argv.size()));
+    for (size_t i=0; sent && i < argv.size(); ++i)
+        sent = sendField(fd, argv[i]);
+    sent = sent && sendField(fd, source);
+
+    string code;
+    bool received = sent
+        && readField(fd, code)
+        && readField(fd, diagnostics)
+        && readField(fd, object);
+
+    close(fd);
+
+    if (!received || code.empty())
+        return false;
+
+    status = std::atoi(code.c_str());
+
+    return true;
+}
+
+#endif // !_WIN32
+
+
+int distCompile(const string& hosts, const list& command)
+{
+    if (command.empty())
+        return 1;
+
+#if defined(_WIN32)
+    (void)hosts;
+    return runCommand(command);
+#else
+    std::vector<DistHost> workers;
+    list argv;
+    string suffix, input, output;
+
+    if (!parseDistHosts(hosts, workers) || !remoteCommand(command, argv, suffix, input, output))
+        return runCommand(command);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    /*
+     * Preprocess with the same flags, which also writes the depfile. -MT,
+     * since it would otherwise name the .i.
+     */
+
+    auto given = [&command](const char* arg) {
+        return std::find(command.cbegin(), command.cend(), arg) != command.cend();
+    };
+
+    string preprocessed = temporaryName(output) + suffix;
+    list preprocess = { command.front() };
+    if ((given("-MD") || given("-MMD")) && !given("-MT")) {
+        preprocess.push_back("-MT");
+        preprocess.push_back(output);
+    }
+
+    for (size_t i=1; i < command.size(); ++i) {
+        if (command[i] == "-c") {
+            preprocess.push_back("-E");
+        } else if (command[i] == "-o" && i + 1 < command.size()) {
+            preprocess.push_back("-o");
+            preprocess.push_back(preprocessed);
+            ++i;
+        } else {
+            preprocess.push_back(command[i]);
+        }
+    }
+
+    /*
+     * The compile would fail the same way, and has already said why.
+     */
+    std::error_code ec;
+    int rc = runCommand(preprocess);
+    if (rc != 0) {
+        fs::remove(preprocessed, ec);
+        return rc;
+    }
+
+    string source = readFile(preprocessed);
+    fs::remove(preprocessed, ec);
+
+    /*
+     * Start from a host picked by the output, weighted by jobs, so parallel
+     * compiles spread out without talking to each other.
+     */
+
+    uint64_t total = 0;
+    for (const DistHost& host : workers)
+        total += host.jobs;
+
+    uint64_t pick = fnv1a(output) % total;
+    size_t first = 0;
+    while (pick >= workers[first].jobs) {
+        pick -= workers[first].jobs;
+        ++first;
+    }
+
+    for (size_t i=0; i < workers.size(); ++i) {
+        const DistHost& host = workers[(first + i) % workers.size()];
+        int status = 1;
+        string diagnostics, object;
+
+        if (!compileOn(host, argv, suffix, source, status, diagnostics, object))
+            continue;
+
+        std::cerr << diagnostics;
+        if (status != 0)
+            return status;
+
+        string tmp = temporaryName(output);
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(object.data(), object.size());
+        out.close();
+
+        fs::rename(tmp, output, ec);
+        if (!out || ec) {
+            std::clog << "cannot write " << output << endl;
+            fs::remove(tmp, ec);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    std::clog << "no distributed host answered; compiling " << input << " here" << endl;
+
+    return runCommand(command);
+#endif
+}
+
+
+#if !defined(_WIN32)
+
+/*
+ * Returns why argv isn't fit to run, or empty if it is.
+ */
+static string refuse(const list& argv)
+{
+    const string& compiler = argv.front();
+
+    if (compiler.find_first_of("/\\") != string::npos)
+        return compiler;
+
+    bool known = compiler == "cc" || compiler == "c++"
+        || compiler.find("gcc") != string::npos
+        || compiler.find("g++") != string::npos
+        || compiler.find("clang") != string::npos;
+    if (!known)
+        return compiler;
+
+    for (size_t i=1; i < argv.size(); ++i) {
+        const string& arg = argv[i];
+
+        if (arg.empty() || (arg[0] != '-' && !takesCompileValue(argv[i - 1])))
+            return "'" + arg + "'";
+        if (takesPath(arg))
+            return arg;
+    }
+
+    return "";
+}
+
+
+static bool reply(int fd, int status, const string& diagnostics, const string& object)
+{
+    return sendField(fd, std::to_string(status))
+        && sendField(fd, diagnostics)
+        && sendField(fd, object);
+}
+
+
+static void serve(int fd)
+{
+    string magic, suffix, count;
+
+    if (!readField(fd, magic) || magic != protocol
+        || !readField(fd, suffix) || (suffix != ".i" && suffix != ".ii")
+        || !readField(fd, count))
+    {
+        return;
+    }
+
+    unsigned long argc = std::strtoul(count.c_str(), nullptr, 10);
+    if (argc == 0 || argc > 4096)
+        return;
+
+    list argv(argc);
+    for (string& arg : argv) {
+        if (!readField(fd, arg))
+            return;
+    }
+
+    string source;
+    if (!readField(fd, source))
+        return;
+
+    string refused = refuse(argv);
+    if (!refused.empty()) {
+        reply(fd, 1, "ngen worker: refusing to run " + refused + "\n", "");
+        return;
+    }
+
+    string pattern = (fs::temp_directory_path() / "ngen-dist.XXXXXX").string();
+    if (mkdtemp(&pattern[0]) == nullptr) {
+        reply(fd, 1, "ngen worker: cannot make a directory to compile in\n", "");
+        return;
+    }
+    fs::path dir = pattern;
+
+    string input = "source" + suffix;
+    std::ofstream(dir / input, std::ios::binary) << source;
+
+    /*
+     * The directory is random, keep it out of the debug info so objects are
+     * the same whichever worker made them.
+     */
+    argv.push_back("-fdebug-prefix-map=" + dir.string() + "=.");
+    argv.push_back("-c");
+    argv.push_back(input);
+    argv.push_back("-o");
+    argv.push_back("source.o");
+
+    int status = 1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        int err = open((dir / "diagnostics").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (chdir(dir.c_str()) != 0 || err < 0)
+            _exit(127);
+        dup2(err, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+
+        std::vector<char*> args;
+        for (string& arg : argv)
+            args.push_back(&arg[0]);
+        args.push_back(nullptr);
+
+        execvp(args[0], args.data());
+        _exit(127);
+    } else if (pid > 0) {
+        int wstatus = 0;
+        while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR)
+            ;
+        status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1;
+    }
+
+    string diagnostics = readFile((dir / "diagnostics").string());
+    if (status == 127 && diagnostics.empty())
+        diagnostics = "ngen worker: cannot run " + argv.front() + "\n";
+
+    reply(fd, status, diagnostics, status == 0 ? readFile((dir / "source.o").string()) : "");
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+}
+
+
+static void work(int listener)
+{
+    for (;;) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        serve(fd);
+        close(fd);
+    }
+}
+
+#endif // !_WIN32
+
+
+int distWorkers(const string& address, unsigned jobs)
+{
+#if defined(_WIN32)
+    (void)jobs;
+    std::clog << "cannot serve compiles on " << address << ": not supported on Windows" << endl;
+    return Ex_Usage;
+#else
+    std::vector<DistHost> hosts;
+    if (!parseDistHosts(address, hosts) || hosts.size() != 1)
+        return Ex_Usage;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo* addresses = nullptr;
+    int rc = getaddrinfo(hosts[0].host.c_str(), hosts[0].port.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        std::clog << "cannot resolve " << address << ": " << gai_strerror(rc) << endl;
+        return Ex_NoInput;
+    }
+
+    int listener = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+    int on = 1;
+    bool listening = listener >= 0
+        && setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0
+        && bind(listener, addresses->ai_addr, addresses->ai_addrlen) == 0
+        && listen(listener, 64) == 0;
+    freeaddrinfo(addresses);
+
+    if (!listening) {
+        std::clog << "cannot listen on " << address << ": " << std::strerror(errno) << endl;
+        return Ex_CantCreate;
+    }
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::clog << "serving compiles on " << address << " with " << jobs << " workers" << endl;
+
+    /*
+     * Each worker takes a connection at a time, so a farm of jobs machines
+     * is jobs processes accepting on one socket. One that dies is replaced.
+     */
+
+    unsigned running = 0;
+    for (;;) {
+        while (running < jobs) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                work(listener);
+                _exit(0);
+            }
+            if (pid < 0) {
+                std::clog << "cannot start a worker: " << std::strerror(errno) << endl;
+                return Ex_CantCreate;
+            }
+            ++running;
+        }
+
+        if (wait(nullptr) > 0)
+            --running;
+        else if (errno != EINTR)
+            return 0;
+    }
+#endif
+}
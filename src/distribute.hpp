@@ -0,0 +1,79 @@
+#ifndef NGEN_DISTRIBUTE__HPP
+#define NGEN_DISTRIBUTE__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/*
+ * Distributed compiles, for gcc's compiles to run through.
+ *
+ * The compile is preprocessed here, then the .i and the flags that matter
+ * after preprocessing go to a worker, which compiles and sends back the
+ * object. Workers speak a small protocol over TCP; every field is a
+ * decimal length, a newline, and that many bytes:
+ *
+ *   request:  "ngen-dist 1", suffix, argc, argv..., source
+ *   response: exit status, diagnostics, object
+ *
+ * The worker runs argv[0] from its $PATH with argv and -c source.suffix
+ * -o object appended. So it needs the same compiler as the client.
+ */
+
+#include <string>
+#include <vector>
+
+/** A worker from --distribute: HOST[:PORT][/JOBS].
+ */
+struct DistHost
+{
+    std::string host;
+    std::string port;
+    /** How many compiles it takes at once. */
+    unsigned jobs;
+};
+
+/** The port workers listen on by default.
+ */
+extern const char* defaultDistPort;
+
+/** Parse hosts, a comma or space separated list, into DistHosts.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool parseDistHosts(const std::string& hosts, std::vector<DistHost>& out);
+
+/** Run the compile in command on one of hosts.
+ *
+ * Hosts are tried in turn from one picked by the output's name, in
+ * proportion to their jobs. If none can be reached the compile is run
+ * here, as are commands that aren't a single -c source to -o object, or
+ * that use modules.
+ *
+ * @returns the exit status of the compile.
+ */
+int distCompile(const std::string& hosts, const std::vector<std::string>& command);
+
+/** Serve compiles on address with jobs worker processes, until killed.
+ *
+ * A stand-in for a farm of machines: address is HOST:PORT, and should be
+ * a loopback address since the workers run whatever gcc is asked to.
+ *
+ * @returns >= 0 on failure, with a message on std::clog.
+ */
+int distWorkers(const std::string& address, unsigned jobs);
+
+#endif // NGEN_DISTRIBUTE__HPP
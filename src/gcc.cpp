@@ -16,8 +16,16 @@
 
 #include "gcc.hpp"
 
+#include "Bundle.hpp"
 #include "Statement.hpp"
+#include "filesystem.hpp"
 #include "path.hpp"
+#include "util.hpp"
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <sstream>
 
 using std::endl;
 
@@ -40,12 +48,95 @@ bool gcc::generateVariables(const json& project)
 
     output()
         << "# GNU Compiler Collection." << endl
-        << "cc  = gcc" << endl
-        << "cxx = g++" << endl
+        << "cc  = " << compiler(project, "cc") << endl
+        << "cxx = " << compiler(project, "cxx") << endl
         << "make = make" << endl
         << endl
         ;
 
+    /*
+     * With LTO the archive tools need the plugin to index the objects; the
+     * gcc- wrappers load it.
+     */
+
+    json lto = ltoSettings(project);
+
+    if (lto.is_null()) {
+        output()
+            << "ar = ar" << endl
+            << "nm = nm" << endl
+            << "ranlib = ranlib" << endl
+            << endl
+            ;
+    } else {
+        output()
+            << "ar = gcc-ar" << endl
+            << "nm = gcc-nm" << endl
+            << "ranlib = gcc-ranlib" << endl
+            << "# link time optimization, for compiles and links alike." << endl
+            << "ltoflags = " << ltoFlags(lto) << endl
+            << endl
+            ;
+    }
+
+    if (buildsSharedLibrary(project, projectType())) {
+        output()
+            << "# shared libraries need position independent code." << endl
+            << "picflags = -fPIC" << endl
+            << endl
+            ;
+    }
+
+    json debug = debugSettings(project);
+    string linker = selectedLinker(project);
+
+    if (!debug.is_null()) {
+        string mode = debug.value("mode", "split");
+        string compress = debug.value("compress", "");
+
+        output()
+            << "# debug info, kept out of installed binaries." << endl
+            << "objcopy = objcopy" << endl
+            << "debugflags = -g" << (mode == "split" ? " -gsplit-dwarf" : "") << endl
+            << "debugldflags = " << debugLinkFlags(project, linker) << endl
+            << "debugcompress =" << (compress.empty() ? "" : " --compress-debug-sections=" + compress) << endl
+            ;
+
+        /*
+         * The .dwo files stay in $builddir, so installing packs them into a
+         * .dwp that gdb finds beside the binary. binutils' dwp can't read
+         * the DWARF 5 that gcc 11 and later write, llvm-dwp can.
+         */
+        if (mode == "split") {
+            string dwp = toolIdentity("llvm-dwp") != "llvm-dwp" ? "llvm-dwp" : "dwp";
+            output() << "dwp = " << debug.value("dwp", dwp) << endl;
+        }
+        output() << endl;
+    }
+
+    if (!linker.empty()) {
+        output()
+            << "# link with " << linker << " instead of the default." << endl
+            << "linkerflags = " << linkerFlags(project, linker) << endl
+            << endl
+            ;
+    }
+
+    if (!bundle().launcher.empty()) {
+        output()
+            << "# runs compiles, e.g. ccache." << endl
+            << "launcher = " << launcher() << endl
+            ;
+    }
+
+    if (!bundle().launcher.empty() || restatObjects(project)) {
+        output()
+            << "# keeps the build's location out of objects, so they can be shared between trees." << endl
+            << "prefixmap = " << prefixMapFlags() << endl
+            << endl
+            ;
+    }
+
     return true;
 }
 
@@ -79,58 +170,162 @@ bool gcc::generateRules()
      * C programs
      */
 
+    string c_compile = measured("$launcher $cc -MMD -MF $out.d $cppflags $pchflags $picflags $cflags $debugflags $ltoflags $prefixmap");
+
     output()
         << "# compile *.c -> *.o" << endl
         << "rule c_compile" << endl
         << indent << "description = CC $in -> $out" << endl
         << indent << "depfile = $out.d" << endl
         << indent << "deps = gcc" << endl
-        << indent << "command = $cc -MMD -MF $out.d $cppflags $cflags -o $out -c $in" << endl
+        << indent << "command = " << c_compile << " -o $out -c $in" << endl
         << endl
         ;
 
+    generateRestatCompileRule("compile *.c -> *.o, keeping $out if it's unchanged", "c_compile_restat", "CC", c_compile);
+
     output()
-        << "# link *.o -> executable" << endl
-        << "rule c_application" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cc $ldflags -o $out $in $ldlibs" << endl
-        << endl
-        ;
-    output()
-        << "# link *.o -> *.so" << endl
-        << "rule c_library" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cc $ldflags -shared -o $out $in $ldlibs" << endl
+        << "# precompile *.h -> *.h.gch" << endl
+        << "rule c_pch" << endl
+        << indent << "description = PCH $in -> $out" << endl
+        << indent << "depfile = $out.d" << endl
+        << indent << "deps = gcc" << endl
+        << indent << "command = " << measured("$cc -MMD -MF $out.d $cppflags $picflags $cflags $debugflags $ltoflags $prefixmap -x c-header -o $out -c $in") << endl
         << endl
         ;
 
+    generateRuleWithResponseFile("link *.o -> executable", "c_application", "LD $in -> $out", "link_pool",
+                                 measured("$cc $ldflags $linkerflags $debugldflags $ltoflags -o $out $in $ldlibs"));
+    generateRuleWithResponseFile("link *.o -> *.so", "c_library", "LD $in -> $out", "link_pool",
+                                 measured("$cc $ldflags $linkerflags $debugldflags $ltoflags -shared -o $out $in $ldlibs"));
+
+    /*
+     * Static libraries. T makes a thin archive: it refers to the objects
+     * rather than copying them, so that's no work at all. It's only good
+     * where the objects are, so distdir gets a full archive.
+     */
+
+    generateRuleWithResponseFile("archive *.o -> *.a", "c_static_library", "AR $out", "",
+                                 "rm -f $out && $ar rcsT $out $in");
+    generateRuleWithResponseFile("archive *.o -> *.a", "cxx_static_library", "AR $out", "",
+                                 "rm -f $out && $ar rcsT $out $in");
+    generateRuleWithResponseFile("archive *.o -> *.a for installing", "install_archive", "INSTALL $out", "",
+                                 "rm -f $out && $ar rcs $out $in");
+
     /*
      * CXX programs
      */
 
+    string cxx_compile = measured("$launcher $cxx -MMD -MF $out.d $cppflags $pchflags $picflags $cxxflags $moduleflags $debugflags $ltoflags $prefixmap");
+
     output()
         << "# compile *.cpp -> *.o" << endl
         << "rule cxx_compile" << endl
         << indent << "description = CXX $in -> $out" << endl
         << indent << "depfile = $out.d" << endl
         << indent << "deps = gcc" << endl
-        << indent << "command = $cxx -MMD -MF $out.d $cppflags $cxxflags -o $out -c $in" << endl
+        << indent << "command = " << cxx_compile << " -o $out -c $in" << endl
+        << endl
+        ;
+
+    generateRestatCompileRule("compile *.cpp -> *.o, keeping $out if it's unchanged", "cxx_compile_restat", "CXX", cxx_compile);
+
+    output()
+        << "# precompile *.h -> *.h.gch" << endl
+        << "rule cxx_pch" << endl
+        << indent << "description = PCH $in -> $out" << endl
+        << indent << "depfile = $out.d" << endl
+        << indent << "deps = gcc" << endl
+        << indent << "command = " << measured("$cxx -MMD -MF $out.d $cppflags $picflags $cxxflags $debugflags $ltoflags $prefixmap -x c++-header -o $out -c $in") << endl
+        << endl
+        ;
+
+    /*
+     * C++ modules. The scan preprocesses for the P1689 info on what $in
+     * provides and imports; the collate is ngen itself, turning all of a
+     * project's scans into a dyndep file and a module mapper.
+     */
+
+    output()
+        << "# scan *.cpp -> *.ddi for modules" << endl
+        << "rule cxx_scan" << endl
+        << indent << "description = SCAN $in" << endl
+        << indent << "depfile = $out.d" << endl
+        << indent << "deps = gcc" << endl
+        << indent << "command = $cxx $cppflags $cxxflags -fmodules-ts -E -x c++ $in -MT $out -MD -MF $out.d"
+        << " -fdeps-format=p1689r5 -fdeps-file=$out -fdeps-target=$obj -o $out.i" << endl
+        << endl
+        ;
+
+    output()
+        << "# collate *.ddi -> dyndep for modules" << endl
+        << "rule cxx_collate" << endl
+        << indent << "description = COLLATE $out" << endl
+        << indent << "restat = true" << endl
+        << indent << "rspfile = $out.rsp" << endl
+        << indent << "rspfile_content = $in" << endl
+        << indent << "command = $ngen --collate-modules $out $builddir/modules.map $gcmdir @$out.rsp" << endl
         << endl
         ;
 
     // XXX: same note as c_application
+    generateRuleWithResponseFile("link *.o -> executable", "cxx_application", "LD $in -> $out", "link_pool",
+                                 measured("$cxx $ldflags $linkerflags $debugldflags $ltoflags -o $out $in $ldlibs"));
+    generateRuleWithResponseFile("link *.o -> *.so", "cxx_library", "LD $in -> $out", "link_pool",
+                                 measured("$cxx $ldflags $linkerflags $debugldflags $ltoflags -shared -o $out $in $ldlibs"));
+
+    /*
+     * Split out the debug info, then install a stripped copy that points at
+     * it. The debuglink is just the file name, so they have to stay together.
+     */
+
+    output()
+        << "# install $in -> $out stripped, and $out" << debugExtension() << endl
+        << "rule install_debug" << endl
+        << indent << "description = INSTALL $in -> $out" << endl
+        << indent << "command = $objcopy --only-keep-debug $debugcompress $in $out" << debugExtension()
+        << " && $objcopy --strip-debug --add-gnu-debuglink=$out" << debugExtension() << " $in $out" << endl
+        << endl
+        << "# install $in -> $out stripped, $out" << debugExtension() << ", and its .dwo files packed into $out.dwp" << endl
+        << "rule install_debug_split" << endl
+        << indent << "description = INSTALL $in -> $out" << endl
+        << indent << "command = $objcopy --only-keep-debug $debugcompress $in $out" << debugExtension()
+        << " && $objcopy --strip-debug --add-gnu-debuglink=$out" << debugExtension() << " $in $out"
+        << " && $dwp -e $in -o $out.dwp" << endl
+        << endl
+        ;
+
+    /*
+     * The exported symbols, less addresses and the sizes of code that will
+     * differ with any edit. Only replaced when different, so restat stops
+     * dependents relinking.
+     */
+
     output()
-        << "# link *.o -> executable" << endl
-        << "rule cxx_application" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cxx $ldflags -o $out $in $ldlibs" << endl
+        << "# stamp the dynamic symbols of $in -> $out" << endl
+        << "rule interface_stamp" << endl
+        << indent << "description = STAMP $out" << endl
+        << indent << "restat = true" << endl
+        << indent << "command = $nm -D --defined-only -P $in"
+        << " | awk '{ print $$1, $$2, ($$2 ~ /^[TtWw]$$/ ? \"\" : $$4) }' | sort > $out.tmp"
+        << " && if cmp -s $out.tmp $out; then rm -f $out.tmp; else mv -f $out.tmp $out; fi" << endl
         << endl
         ;
+
+    /*
+     * Time a link of the objects with $linker. There's no output but the
+     * time, so it's in the console pool.
+     */
+
     output()
-        << "# link *.o -> *.so" << endl
-        << "rule cxx_library" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cxx $ldflags -shared -o $out $in $ldlibs" << endl
+        << "# link $in -> $out with $linker, and say how long it took" << endl
+        << "rule linker_bench" << endl
+        << indent << "description = BENCH $linker $out" << endl
+        << indent << "pool = console" << endl
+        << indent << "rspfile = $out.rsp" << endl
+        << indent << "rspfile_content = $in" << endl
+        << indent << "command = start=$$(date +%s%N) && $link $ldflags $linkerflags $debugldflags $ltoflags $shared -o $out @$out.rsp $ldlibs"
+        << " && echo \"$linker: $$(( ($$(date +%s%N) - start) / 1000000 )) ms\"" << endl
         << endl
         ;
 
@@ -138,6 +333,457 @@ bool gcc::generateRules()
 }
 
 
+void gcc::generateRestatCompileRule(const string& comment, const string& name, const string& description,
+                                    const string& compile)
+{
+    static const char* indent = "    ";
+
+    /*
+     * -MT since the depfile would otherwise name the temporary. The seed
+     * and -Wdate-time are for the same source making the same bytes.
+     */
+
+    output()
+        << "# " << comment << endl
+        << "rule " << name << endl
+        << indent << "description = " << description << " $in -> $out" << endl
+        << indent << "depfile = $out.d" << endl
+        << indent << "deps = gcc" << endl
+        << indent << "restat = true" << endl
+        << indent << "command = " << compile << " -MT $out -frandom-seed=$out -Wdate-time -o $out.tmp -c $in"
+        << " && $ngen --replace-if-changed $out.tmp $out" << endl
+        << endl
+        ;
+}
+
+
+bool gcc::generateBuildStatementsForApplication(const json& project, const string& type, const string& rule)
+{
+    if (!cxxbase::generateBuildStatementsForApplication(project, type, rule))
+        return false;
+
+    return generateLinkerBenchmark(project, type);
+}
+
+
+bool gcc::generateBuildStatementsForLibrary(const json& project, const string& type, const string& rule)
+{
+    if (!cxxbase::generateBuildStatementsForLibrary(project, type, rule))
+        return false;
+
+    if (!buildsSharedLibrary(project, type))
+        return true;
+
+    if (usesInterfaceStamp(project, type)) {
+        Statement stamp("interface_stamp");
+
+        stamp
+            .appendInput(builddir(libraryBase()))
+            .appendOutput(linkArtifact(project, type))
+            ;
+
+        output() << stamp << endl;
+    }
+
+    return generateLinkerBenchmark(project, type);
+}
+
+
+bool gcc::generateLinkerBenchmark(const json& project, const string& type)
+{
+    if (linkerSettings(project).is_null())
+        return true;
+
+    /*
+     * The outputs are never up to date, so it relinks every time it's asked.
+     */
+
+    string always = builddir("linker-bench/always");
+    Statement phony("phony");
+    phony.appendOutput(always);
+    output() << phony << endl;
+
+    onRequest(targetName() + "-linker-bench");
+
+    Statement bench("phony");
+    bench.appendOutput(targetName() + "-linker-bench");
+
+    string driver = linkDriver(project);
+
+    for (const char* linker : { "bfd", "gold", "lld", "mold" }) {
+        if (!probeLinker(driver, linker))
+            continue;
+
+        string out = builddir("linker-bench/" + targetName() + "." + linker);
+        Statement build("linker_bench");
+
+        build
+            .appendInputs(objects(project))
+            .appendOutput(out)
+            .appendDependency(always)
+            .appendVariable("linker", linker)
+            .appendVariable("link", type.find("c_") == 0 ? "$cc" : "$cxx")
+            .appendVariable("linkerflags", linkerFlags(project, linker))
+            .appendVariable("debugldflags", debugLinkFlags(project, linker))
+            ;
+        if (isLibraryType(type))
+            build.appendVariable("shared", "-shared");
+        if (has(project, "dependencies"))
+            build.appendOrderOnlyDependencies(project.at("dependencies"));
+
+        output() << build << endl;
+
+        bench.appendInput(out);
+    }
+
+    output() << bench << endl;
+
+    return true;
+}
+
+
+gcc::json gcc::linkerSettings(const json& project) const
+{
+    /*
+     * "mold" | [ "mold", "lld" ] | { "use": either, "threads": N }
+     */
+    json linker = has(project, "linker") ? project.at("linker") : json();
+
+    if (!bundle().linker.empty()) {
+        linker = json::array();
+        std::istringstream names(bundle().linker);
+        string name;
+        while (std::getline(names, name, ','))
+            linker.push_back(name);
+    }
+
+    if (linker.is_null())
+        return nullptr;
+    if (!linker.is_object())
+        linker = json{ { "use", linker } };
+    if (linker.at("use").is_string())
+        linker["use"] = json::array({ linker.at("use") });
+
+    return linker;
+}
+
+
+gcc::string gcc::selectedLinker(const json& project) const
+{
+    json linker = linkerSettings(project);
+
+    if (linker.is_null())
+        return "";
+
+    string driver = linkDriver(project);
+
+    for (const string& name : linker.at("use")) {
+        if (probeLinker(driver, name))
+            return name;
+        if (debug())
+            log() << "linker " << name << " doesn't work with " << driver << endl;
+    }
+
+    warning() << "none of the linkers " << linker.at("use").dump() << " work; using the default." << endl;
+
+    return "";
+}
+
+
+gcc::string gcc::linkerFlags(const json& project, const string& linker) const
+{
+    json settings = linkerSettings(project);
+    string flags = "-fuse-ld=" + linker;
+
+    /*
+     * mold and lld use every core unless told otherwise; gold only uses
+     * more than one when asked.
+     */
+    int threads = settings.value("threads", 0);
+
+    if (linker == "gold") {
+        flags += " -Wl,--threads";
+        if (threads > 0)
+            flags += " -Wl,--thread-count=" + std::to_string(threads);
+    } else if (linker == "lld" && threads > 0) {
+        flags += " -Wl,--threads=" + std::to_string(threads);
+    } else if (linker == "mold" && threads > 0) {
+        flags += " -Wl,--thread-count=" + std::to_string(threads);
+    }
+
+    return flags;
+}
+
+
+bool gcc::probeLinker(const string& driver, const string& linker) const
+{
+    static std::map<string, bool> probed;
+
+    string key = driver + " " + linker;
+    auto it = probed.find(key);
+    if (it != probed.cend())
+        return it->second;
+
+    /*
+     * Ask the compiler that links to link with it. --version has the linker
+     * say hello and stop, so nothing needs to be built.
+     */
+    string command = driver + " -fuse-ld=" + linker + " -Wl,--version -shared -x c -o /dev/null /dev/null >/dev/null 2>&1";
+    bool ok = std::system(command.c_str()) == 0;
+
+    if (debug())
+        log() << "probe linker " << linker << " with " << driver << ": " << (ok ? "yes" : "no") << endl;
+
+    return probed[key] = ok;
+}
+
+
+gcc::string gcc::compiler(const json& project, const string& name) const
+{
+    if (has(project, generatorName()) && has(project.at(generatorName()), name))
+        return project.at(generatorName()).at(name).get<string>();
+
+    return name == "cc" ? "gcc" : "g++";
+}
+
+
+gcc::string gcc::linkDriver(const json& project) const
+{
+    return compiler(project, projectType().find("c_") == 0 ? "cc" : "cxx");
+}
+
+
+gcc::string gcc::debugLinkFlags(const json& project, const string& linker) const
+{
+    json debug = debugSettings(project);
+
+    if (debug.is_null() || debug.value("mode", "split") != "split")
+        return "";
+
+    /*
+     * Split DWARF leaves most debug info in .dwo files beside the objects,
+     * so the linker has far less to chew on. --gdb-index saves gdb from
+     * building an index on every load; GNU ld doesn't have it, so it's
+     * only on by default with gold, lld or mold.
+     */
+    bool gdbIndex = debug.value("gdb_index", linker == "gold" || linker == "lld" || linker == "mold");
+
+    return gdbIndex ? "-Wl,--gdb-index" : "";
+}
+
+
+gcc::string gcc::librarySearchFlags(const list& dirs) const
+{
+    /*
+     * -L are searched in order, so these go ahead of the user's -L$distdir.
+     */
+    string r;
+
+    for (const string& dir : dirs)
+        r += "-L" + dir + " ";
+
+    return r + "$ldflags";
+}
+
+
+gcc::string gcc::linkArtifact(const json& project, const string& type) const
+{
+    /*
+     * In the same directory, so librarySearchFlags() still finds the library.
+     */
+    if (usesInterfaceStamp(project, type))
+        return builddir(libraryBase()) + ".interface";
+
+    return cxxbase::linkArtifact(project, type);
+}
+
+
+bool gcc::usesInterfaceStamp(const json& project, const string& type) const
+{
+    return buildsSharedLibrary(project, type)
+        && has(project, "interface_stamp") && project.at("interface_stamp").get<bool>();
+}
+
+
+gcc::string gcc::installRule(const json& project) const
+{
+    json debug = debugSettings(project);
+
+    if (debug.is_null())
+        return cxxbase::installRule(project);
+
+    return debug.at("mode") == "split" ? "install_debug_split" : "install_debug";
+}
+
+
+gcc::string gcc::debugExtension() const
+{
+    return ".debug";
+}
+
+
+gcc::list gcc::debugExtensions(const json& project) const
+{
+    json debug = debugSettings(project);
+
+    if (!debug.is_null() && debug.at("mode") == "split")
+        return { debugExtension(), ".dwp" };
+
+    return cxxbase::debugExtensions(project);
+}
+
+
+gcc::json gcc::debugSettings(const json& project) const
+{
+    /*
+     * "split" | "separate" | { "mode": ..., "compress": ..., "gdb_index": ... }
+     */
+    json debug = has(project, "debug") ? project.at("debug") : json();
+
+    if (debug.is_string())
+        debug = json{ { "mode", debug } };
+    if (debug.is_null() || debug.value("mode", "split") == "none")
+        return nullptr;
+
+    /*
+     * Always with a mode, so callers can read it as is.
+     */
+    string mode = debug.value("mode", "split");
+    if (mode != "split" && mode != "separate") {
+        warning() << "unknown debug mode " << mode << "; using split." << endl;
+        mode = "split";
+    }
+    debug["mode"] = mode;
+
+    return debug;
+}
+
+
+gcc::string gcc::linkPool(const json& project) const
+{
+    if (ltoSettings(project).is_null())
+        return "";
+
+    return "lto_pool";
+}
+
+
+gcc::json gcc::ltoSettings(const json& project) const
+{
+    /*
+     * true | "full" | "partitioned" | { "mode": ..., "jobs": ..., "fat_objects": ... }
+     */
+    json lto = has(project, "lto") ? project.at("lto") : json();
+
+    if (!bundle().lto.empty())
+        lto = bundle().lto;
+
+    if (lto.is_boolean())
+        lto = lto.get<bool>() ? json("partitioned") : json();
+    if (lto.is_string())
+        lto = json{ { "mode", lto } };
+    if (lto.is_null() || lto.value("mode", "partitioned") == "none")
+        return nullptr;
+
+    return lto;
+}
+
+
+gcc::string gcc::ltoFlags(const json& lto) const
+{
+    string mode = lto.value("mode", "partitioned");
+    string flags;
+
+    /*
+     * -flto=auto uses make's jobserver if there is one, else a job per
+     * core. jobserver insists on make's, for when ninja is run by make.
+     */
+    json jobs = lto.value("jobs", json("auto"));
+    flags = "-flto=" + (jobs.is_number() ? std::to_string(jobs.get<int>()) : jobs.get<string>());
+
+    /*
+     * full is one partition: a single serial LTRANS, like classic LTO.
+     * partitioned splits the program for LTRANS jobs to run in parallel,
+     * which is about as close to ThinLTO as GCC gets.
+     */
+    if (mode == "full") {
+        flags += " -flto-partition=one";
+    } else if (mode == "partitioned") {
+        flags += " -flto-partition=balanced";
+    } else {
+        warning() << "unknown lto mode " << mode << "; using partitioned." << endl;
+        flags += " -flto-partition=balanced";
+    }
+
+    /*
+     * Fat objects carry regular code too, so they still link without LTO,
+     * at the cost of compiling everything twice.
+     */
+    if (lto.value("fat_objects", false))
+        flags += " -ffat-lto-objects";
+    else
+        flags += " -fno-fat-lto-objects";
+
+    return flags;
+}
+
+
+gcc::string gcc::launcher() const
+{
+    string launcher = bundle().launcher;
+
+    /*
+     * ccache otherwise hashes absolute paths in flags like -I/abs/include as
+     * is, and with -g the directory it runs in. With a base_dir they're
+     * rewritten relative to the cwd first, and the cwd is left out. These
+     * are settings rather than flags, so the compile's argv stays the same
+     * from tree to tree.
+     */
+    if (filename(launcher.substr(0, launcher.find(' '))) == "ccache") {
+        launcher = "CCACHE_BASEDIR=" + std::filesystem::current_path().string()
+            + " CCACHE_NOHASHDIR=true " + launcher;
+    }
+
+    return launcher;
+}
+
+
+gcc::string gcc::prefixMapFlags() const
+{
+    namespace fs = std::filesystem;
+
+    /*
+     * Ninja runs from the current directory and hands the compiler paths
+     * relative to it, so __FILE__ is relative already. What's left is the
+     * working directory, which -g puts at the top of the preprocessed
+     * source that ccache and sccache hash; -fno-working-directory takes it
+     * out of there. A prefix map would name it in every compile's argv,
+     * and so in their keys.
+     *
+     * ngen's own object cache only keys what a map maps to, so with it the
+     * directory is mapped to "." in the debug info too. An absolute
+     * sourcedir somewhere else is in argv regardless, so it's mapped.
+     *
+     * GCC takes the last matching map, so the more specific goes last.
+     * -ffile-prefix-map covers the debug info too on GCC 8+, but ccache only
+     * knows about -fdebug-prefix-map when deciding the cwd doesn't matter.
+     */
+    list dirs;
+    if (!bundle().objectCache.empty())
+        dirs.push_back(fs::current_path().string());
+
+    fs::path source(bundle().sourcedir);
+    if (source.is_absolute() && source.lexically_normal() != fs::current_path())
+        dirs.push_back(source.lexically_normal().string());
+
+    string flags = "-fno-working-directory";
+    for (const string& dir : dirs)
+        flags += " -ffile-prefix-map=" + dir + "=. -fdebug-prefix-map=" + dir + "=.";
+
+    return flags;
+}
+
+
 gcc::string gcc::objectExtension() const
 {
     /*
@@ -147,6 +793,122 @@ gcc::string gcc::objectExtension() const
 }
 
 
+gcc::string gcc::staticLibraryPrefix() const
+{
+    return "lib";
+}
+
+
+gcc::string gcc::staticLibraryExtension() const
+{
+    return ".a";
+}
+
+
+gcc::string gcc::precompiledHeaderExtension() const
+{
+    /*
+     * GCC looks for foo.h.gch before foo.h.
+     */
+    return ".gch";
+}
+
+
+gcc::string gcc::precompiledHeaderFlags(const string& header) const
+{
+    /*
+     * A .gch built with different flags is silently skipped otherwise.
+     */
+    return "-Winvalid-pch -include " + header;
+}
+
+
+gcc::string gcc::precompiledHeaderSignature(const json& project) const
+{
+    /*
+     * GCC wants the same compiler and code generation flags, e.g. it won't
+     * take a -fPIC header for a -fpie compile. Where headers are found may
+     * differ, so include paths are left out. Sorted, since order and
+     * repeats don't matter to it either.
+     */
+    std::set<string> words;
+    bool path = false;
+
+    auto add = [&words, &path](const string& flags) {
+        std::istringstream in(flags);
+        string word;
+
+        while (in >> word) {
+            if (path) {
+                path = false;
+            } else if (word == "-I" || word == "-isystem" || word == "-iquote" || word == "-idirafter") {
+                path = true;
+            } else if (word.compare(0, 2, "-I") != 0 && word.compare(0, 8, "-isystem") != 0
+                && word.compare(0, 7, "-iquote") != 0 && word.compare(0, 10, "-idirafter") != 0)
+            {
+                words.insert(word);
+            }
+        }
+    };
+
+    string type = projectType();
+    bool c = type.find("c_") == 0;
+
+    if (buildsSharedLibrary(project, type))
+        add("-fPIC");
+
+    if (has(project, generatorName())) {
+        const json& flags = project.at(generatorName());
+
+        for (const char* name : { "cppflags", c ? "cflags" : "cxxflags" }) {
+            if (!has(flags, name)) {
+                continue;
+            } else if (flags.at(name).is_array()) {
+                for (const string& word : flags.at(name))
+                    add(word);
+            } else {
+                add(flags.at(name).get<string>());
+            }
+        }
+    }
+
+    json debug = debugSettings(project);
+    if (!debug.is_null())
+        add(debug.at("mode") == "split" ? "-g -gsplit-dwarf" : "-g");
+
+    json lto = ltoSettings(project);
+    if (!lto.is_null())
+        add(ltoFlags(lto));
+
+    string r = compiler(project, c ? "cc" : "cxx");
+    for (const string& word : words)
+        r += " " + word;
+
+    return r;
+}
+
+
+bool gcc::supportsRestatObjects() const
+{
+    return true;
+}
+
+
+bool gcc::supportsDistribution() const
+{
+    return true;
+}
+
+
+gcc::string gcc::moduleFlags(const string& mapper) const
+{
+    /*
+     * GCC doesn't know .cppm and friends, hence -x.
+     */
+    return "-fmodules-ts -fmodule-mapper=" + mapper + " -x c++";
+}
+
+
 gcc::string gcc::applicationExtension() const
 {
     /*
@@ -30,6 +30,8 @@ class gcc : public cxxbase
 
     bool generateVariables(const json& project) override;
     bool generateRules() override;
+    bool generateBuildStatementsForApplication(const json& project, const string& type, const string& rule) override;
+    bool generateBuildStatementsForLibrary(const json& project, const string& type, const string& rule) override;
 
   protected:
 
@@ -37,8 +39,114 @@ class gcc : public cxxbase
     string applicationExtension() const override;
     string libraryPrefix() const override;
     string libraryExtension() const override;
+    string staticLibraryPrefix() const override;
+    string staticLibraryExtension() const override;
+    string precompiledHeaderExtension() const override;
+    string precompiledHeaderFlags(const string& header) const override;
+    string precompiledHeaderSignature(const json& project) const override;
+    string moduleFlags(const string& mapper) const override;
+    bool supportsRestatObjects() const override;
+    bool supportsDistribution() const override;
+    string linkPool(const json& project) const override;
+    string librarySearchFlags(const list& dirs) const override;
+    string linkArtifact(const json& project, const string& type) const override;
+    string installRule(const json& project) const override;
+    string debugExtension() const override;
+    list debugExtensions(const json& project) const override;
 
   private:
+
+    /** Generate a compile rule that writes $out only when it changes.
+     *
+     * @param compile the compile command, up to -o.
+     */
+    void generateRestatCompileRule(const string& comment, const string& name, const string& description,
+                                   const string& compile);
+
+    /** Generate {targetName()}-linker-bench, which links project's objects
+     * with each linker that works and reports how long each took.
+     *
+     * Only done for projects with a linker setting.
+     */
+    bool generateLinkerBenchmark(const json& project, const string& type);
+
+    /** Returns /project/linker, or --linker, in its object form; null for
+     * the default.
+     *
+     * Either a linker name for -fuse-ld, a list of them in order of
+     * preference, or an object with those as "use" and a "threads" count.
+     */
+    json linkerSettings(const json& project) const;
+
+    /** Returns the first linkerSettings() linker that works, or "".
+     */
+    string selectedLinker(const json& project) const;
+
+    /** Returns the flags to link with linker.
+     */
+    string linkerFlags(const json& project, const string& linker) const;
+
+    /** Returns if driver, the compiler that links, can link with linker.
+     */
+    bool probeLinker(const string& driver, const string& linker) const;
+
+    /** Returns the compiler for name, "cc" or "cxx".
+     *
+     * /project/gcc/cc and /project/gcc/cxx, or gcc and g++.
+     */
+    string compiler(const json& project, const string& name) const;
+
+    /** Returns the compiler() that links project: cc for C, cxx otherwise.
+     */
+    string linkDriver(const json& project) const;
+
+    /** Returns the debug info flags for linking project with linker:
+     * -Wl,--gdb-index for split DWARF when it has one, or "".
+     */
+    string debugLinkFlags(const json& project, const string& linker) const;
+
+    /** Returns /project/debug in its object form; null for none.
+     *
+     * Either "split", "separate", "none", or an object with a "mode" of
+     * those, "compress" for --compress-debug-sections (zlib, zstd),
+     * "gdb_index" for --gdb-index, which defaults to on when the linker is
+     * gold, lld or mold, and "dwp" for the tool that packs .dwo files.
+     * split compiles with -gsplit-dwarf, and is the mode when none is given;
+     * the object returned always has one. Both install stripped files and a
+     * .debug for each, and split a .dwp too.
+     */
+    json debugSettings(const json& project) const;
+
+    /** Returns /project/lto, or --lto, in its object form; null for none.
+     *
+     * Either true, "full", "partitioned", "none", or an object with a "mode"
+     * of those, "jobs" for -flto= (auto, jobserver, or a number), and
+     * "fat_objects" for -ffat-lto-objects.
+     */
+    json ltoSettings(const json& project) const;
+
+    /** Returns the flags for ltoSettings().
+     */
+    string ltoFlags(const json& lto) const;
+
+    /** Returns if project's shared library has an interface stamp.
+     *
+     * /project/interface_stamp set to true makes a $builddir stamp of the
+     * library's exported symbols next to it, rewritten only when they
+     * change. Dependents relink when that does rather than the library, so
+     * changes that don't touch the interface don't ripple through the tree.
+     */
+    bool usesInterfaceStamp(const json& project, const string& type) const;
+
+    /** Returns --launcher with whatever it needs to share between trees.
+     */
+    string launcher() const;
+
+    /** Returns the flags that keep the tree's location out of what a
+     * launcher hashes, without naming it in argv. Only the object cache,
+     * which doesn't key where a prefix map maps from, has it mapped.
+     */
+    string prefixMapFlags() const;
 };
 
 #endif // NGEN_GCC__HPP
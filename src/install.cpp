@@ -0,0 +1,124 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "install.hpp"
+
+#include "filesystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+using std::endl;
+using std::string;
+
+
+/*
+ * True if a and b hold the same bytes.
+ */
+static bool sameContents(const fs::path& a, const fs::path& b)
+{
+    std::error_code ec;
+
+    if (!fs::exists(b, ec) || fs::file_size(a, ec) != fs::file_size(b, ec) || ec)
+        return false;
+
+    std::ifstream x(a, std::ios::binary);
+    std::ifstream y(b, std::ios::binary);
+
+    return x && y
+        && std::equal(std::istreambuf_iterator<char>(x), std::istreambuf_iterator<char>(),
+                      std::istreambuf_iterator<char>(y), std::istreambuf_iterator<char>());
+}
+
+
+bool installFiles(const string& manifest, const string& stamp)
+{
+    std::ifstream in(manifest);
+    if (!in) {
+        std::clog << "cannot open install manifest: " << manifest << endl;
+        return false;
+    }
+
+    /*
+     * Ninja wrote it from $pairs, so it's whitespace separated.
+     */
+    std::vector<string> words{ std::istream_iterator<string>(in), std::istream_iterator<string>() };
+
+    if (words.size() % 2 != 0) {
+        std::clog << manifest << ": " << words.back() << " has nowhere to go" << endl;
+        return false;
+    }
+
+    std::vector<std::pair<string, string>> pairs;
+    for (size_t i=0; i < words.size(); i += 2)
+        pairs.emplace_back(words[i], words[i + 1]);
+
+    /*
+     * Mostly waiting on the filesystem, so a few more than there are cores.
+     */
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency()) * 2;
+    jobs = std::max<size_t>(1, std::min(jobs, pairs.size()));
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    std::mutex logLock;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < pairs.size(); i = next++) {
+            const fs::path source = pairs[i].first;
+            const fs::path dest = pairs[i].second;
+            std::error_code ec;
+
+            if (sameContents(source, dest))
+                continue;
+
+            fs::create_directories(dest.parent_path(), ec);
+            if (!fs::copy_file(source, dest, fs::copy_options::overwrite_existing, ec)) {
+                std::lock_guard<std::mutex> lock(logLock);
+                std::clog << "cannot install " << source.string() << " to " << dest.string() << ": " << ec.message() << endl;
+                ok = false;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (!ok)
+        return false;
+
+    std::ofstream out(stamp, std::ios::trunc);
+    out << pairs.size() << " files" << endl;
+
+    if (!out) {
+        std::clog << "cannot write " << stamp << endl;
+        return false;
+    }
+
+    return true;
+}
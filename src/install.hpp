@@ -0,0 +1,33 @@
+#ifndef NGEN_INSTALL__HPP
+#define NGEN_INSTALL__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+/** Copy every SOURCE DEST pair listed in manifest, then write stamp.
+ *
+ * This is a whole project's headers or install_files in one process,
+ * instead of a cp for every file. Pairs are copied in parallel, and a
+ * DEST already holding the same bytes is left alone, so restat can spare
+ * whatever depends on it.
+ *
+ * @returns false on failure, with a message on std::clog. stamp is only
+ * written when every pair is copied.
+ */
+bool installFiles(const std::string& manifest, const std::string& stamp);
+
+#endif // NGEN_INSTALL__HPP
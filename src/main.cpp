@@ -15,16 +15,30 @@
  */
 
 #include "Bundle.hpp"
+#include "Manifest.hpp"
+#include "NinjaLog.hpp"
 #include "Shinobi.hpp"
+#include "analyze.hpp"
+#include "artifactcache.hpp"
+#include "blast.hpp"
+#include "distribute.hpp"
+#include "filesystem.hpp"
+#include "install.hpp"
+#include "modules.hpp"
+#include "objectcache.hpp"
 #include "path.hpp"
+#include "usage.hpp"
 #include "util.hpp"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <set>
 #include <string>
 #include <nlohmann/json.hpp>
 
@@ -46,6 +60,7 @@ using std::to_string;
 
 extern string defaultCxxGenerator;
 static char* next(int& index, int argc, char**argv);
+static bool nextNumber(int& index, int argc, char**argv, long min, long& number);
 static void usage(const char* name);
 static int options(int argc, char**argv, Bundle& bundle);
 
@@ -66,6 +81,29 @@ static char* next(int& index, int argc, char**argv)
 }
 
 
+/*
+ * Parse next string in argv as a whole number of at least min, or false +
+ * print error.
+ */
+static bool nextNumber(int& index, int argc, char**argv, long min, long& number)
+{
+    const char* value = next(index, argc, argv);
+    if (value == nullptr)
+        return false;
+
+    char* end = nullptr;
+    errno = 0;
+    number = std::strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || errno == ERANGE || number < min) {
+        std::clog << argv[0] << ": bad number for " << argv[index - 1] << ": " << value << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
 static void usage(const char* name)
 {
     std::cout
@@ -82,12 +120,83 @@ static void usage(const char* name)
         << "-q, --quiet                 Turn off verbose mode" << endl
         << endl
         << "--default-cxx-generator X   Use X instead of " << defaultCxxGenerator << endl
+        << "--blast-radius              Report edges invalidated by regenerating." << endl
+        << "--blast-radius-max N        Fail if more than N edges are invalidated." << endl
+        << "--command-hashes FILE       Compare against and save command hashes to FILE." << endl
+        << "--analyze-graph             Write build graph analytics." << endl
+        << "--graph-output PREFIX       Write PREFIX.json and PREFIX.dot. Default ngen-graph" << endl
+        << "--ninja-log FILE            Read edge durations from FILE." << endl
+        << "--analyze-log               Report time per project and slowest edges." << endl
+        << "--top N                     Report N slowest edges. Default 10" << endl
+        << "--trace FILE                Write a Chrome trace to FILE. Default ngen-trace.json" << endl
+        << "--longest-first             Emit edges that took longest last build first." << endl
+        << "--launcher CMD              Run compiles through CMD, e.g. ccache." << endl
+        << "--record-usage              Record what each edge takes, and pool compiles by it next time." << endl
+        << "--lto MODE                  Use LTO MODE for every project: none, full, partitioned." << endl
+        << "--linker LD[,LD...]         Link with the first of LD that works, e.g. mold,lld." << endl
+        << "--rspfile-threshold N       Use response files for links over N inputs. Default 1000" << endl
+        << "--restat-objects            Only replace objects whose bytes changed." << endl
+        << "--bulk-install              Install each project's headers and files in one process." << endl
+        << "--object-cache DIR          Compile through an object cache in DIR." << endl
+        << "--object-cache-size SIZE    Trim the object cache to SIZE, e.g. 500M. Default 5G" << endl
+        << "--artifact-cache DIR        Restore unchanged package children from DIR." << endl
+        << "--distribute HOSTS          Compile on HOST[:PORT][/JOBS],... Links stay here." << endl
+        << "--shards N                  Split a package into N shard-K.ninja to build apart." << endl
+        << "--shard-timeout SECONDS     How long a shard waits for another's artifacts. Default 14400" << endl
         << "--version                   Display " << NGEN_VERSION << endl
         << endl
+        << "usage: " << name << " --collate-modules DYNDEP MAPPER GCMDIR DDI..." << endl
+        << "       " << name << " --replace-if-changed TEMP FILE" << endl
+        << "       " << name << " --install-files MANIFEST STAMP" << endl
+        << "       " << name << " --include-file OUTPUT FILE..." << endl
+        << "       " << name << " --object-cache-compile DIR SIZE COMPILER ARGS..." << endl
+        << "       " << name << " --object-cache-stats DIR" << endl
+        << "       " << name << " --object-cache-zero DIR" << endl
+        << "       " << name << " --artifact-publish DIR METADATA STAMP" << endl
+        << "       " << name << " --artifact-fetch DIR KEY DISTDIR TIMEOUT" << endl
+        << "       " << name << " --dist-compile HOSTS COMPILER ARGS..." << endl
+        << "       " << name << " --dist-workers JOBS [HOST:PORT]" << endl
+        << "       " << name << " --measure DB PROJECT OUTPUT COMMAND ARGS..." << endl
+        << "       " << name << " --usage-summary DB METRICS" << endl
+        << endl
+        << "Helpers used by build.ninja. The first writes the dyndep file and module" << endl
+        << "mapper for scanned C++ modules. The second renames TEMP to FILE, unless" << endl
+        << "they're the same, then TEMP is removed and FILE left alone. The third copies" << endl
+        << "each SOURCE DEST pair in MANIFEST and writes STAMP. The fourth writes OUTPUT" << endl
+        << "to #include each FILE. The next three run a compile through the object" << endl
+        << "cache in DIR, and report or zero its statistics." << endl
+        << "Then two publish a package child's installed files to the artifact cache, and" << endl
+        << "copy them into DISTDIR, waiting up to TIMEOUT seconds for a shard to publish them." << endl
+        << "The next two run a compile on a worker in HOSTS, and serve compiles with" << endl
+        << "JOBS workers on this machine. Default 127.0.0.1:" << defaultDistPort << endl
+        << "The last two run COMMAND and append what it took to make OUTPUT to DB, and" << endl
+        << "report DB per project and write it to METRICS as OpenMetrics." << endl
+        << endl
         ;
 }
 
 
+/** Put back the files of the manifest from before generating, and remove
+ * the generated ones it didn't have.
+ */
+static void restoreManifest(const Manifest& generated, const std::map<string, string>& previous)
+{
+    std::error_code ec;
+
+    for (const string& file : generated.files()) {
+        if (previous.count(file) == 0)
+            std::filesystem::remove(file, ec);
+    }
+
+    for (const auto& pair : previous) {
+        std::ofstream out(pair.first, std::ios::binary | std::ios::trunc);
+        out << pair.second;
+        if (!out)
+            std::clog << "cannot restore " << pair.first << endl;
+    }
+}
+
+
 /** Parse main's argv into Bundle.
  *
  * @returns < 0 on success; >= 0 on failure.
@@ -144,6 +253,123 @@ static int options(int argc, char** argv, Bundle& b)
                 return Ex_Usage;
             defaultCxxGenerator = value;
         }
+        else if (arg == "--blast-radius") {
+            b.blastRadius = true;
+        }
+        else if (arg == "--blast-radius-max") {
+            if (!nextNumber(i, argc, argv, 0, b.blastRadiusMax))
+                return Ex_Usage;
+            b.blastRadius = true;
+        }
+        else if (arg == "--command-hashes") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.blastRadius = true;
+            b.commandHashesPath = value;
+        }
+        else if (arg == "--analyze-graph") {
+            b.analyzeGraph = true;
+        }
+        else if (arg == "--graph-output") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.analyzeGraph = true;
+            b.graphPrefix = value;
+        }
+        else if (arg == "--ninja-log") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.ninjaLogPath = value;
+        }
+        else if (arg == "--analyze-log") {
+            b.analyzeLog = true;
+        }
+        else if (arg == "--top") {
+            long top;
+            if (!nextNumber(i, argc, argv, 0, top))
+                return Ex_Usage;
+            b.analyzeLogTop = static_cast<size_t>(top);
+        }
+        else if (arg == "--trace") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.analyzeLog = true;
+            b.tracePath = value;
+        }
+        else if (arg == "--longest-first") {
+            b.longestFirst = true;
+        }
+        else if (arg == "--record-usage") {
+            b.recordUsage = true;
+        }
+        else if (arg == "--object-cache") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.objectCache = value;
+        }
+        else if (arg == "--object-cache-size") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.objectCacheSize = parseSize(value);
+            if (b.objectCacheSize == 0) {
+                std::clog << argv[0] << ": bad size for --object-cache-size: " << value << endl;
+                return Ex_Usage;
+            }
+        }
+        else if (arg == "--artifact-cache") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.artifactCache = value;
+        }
+        else if (arg == "--shards") {
+            if (!nextNumber(i, argc, argv, 1, b.shards))
+                return Ex_Usage;
+        }
+        else if (arg == "--shard-timeout") {
+            if (!nextNumber(i, argc, argv, 0, b.shardTimeout))
+                return Ex_Usage;
+        }
+        else if (arg == "--distribute") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.distribute = value;
+        }
+        else if (arg == "--restat-objects") {
+            b.restatObjects = true;
+        }
+        else if (arg == "--bulk-install") {
+            b.bulkInstall = true;
+        }
+        else if (arg == "--rspfile-threshold") {
+            if (!nextNumber(i, argc, argv, -1, b.responseFileThreshold))
+                return Ex_Usage;
+        }
+        else if (arg == "--linker") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.linker = value;
+        }
+        else if (arg == "--lto") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.lto = value;
+        }
+        else if (arg == "--launcher") {
+            const char* value = next(i, argc, argv);
+            if (value == nullptr)
+                return Ex_Usage;
+            b.launcher = value;
+        }
         else if (arg == "-C" || arg == "--directory") {
             const char* value = next(i, argc, argv);
             if (value == nullptr)
@@ -171,6 +397,113 @@ static int options(int argc, char** argv, Bundle& b)
 
 int main(int argc, char* argv[])
 {
+    /*
+     * Not a generator run: build.ninja calling us back.
+     */
+    if (argc > 1 && string(argv[1]) == "--collate-modules") {
+        if (argc < 5) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        std::vector<string> ddis(argv + 5, argv + argc);
+        return collateModules(argv[2], argv[3], argv[4], ddis) ? 0 : Ex_CantCreate;
+    }
+    if (argc > 1 && string(argv[1]) == "--replace-if-changed") {
+        if (argc != 4) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return replaceIfChanged(argv[2], argv[3]) ? 0 : Ex_CantCreate;
+    }
+    if (argc > 1 && string(argv[1]) == "--install-files") {
+        if (argc != 4) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return installFiles(argv[2], argv[3]) ? 0 : Ex_CantCreate;
+    }
+    if (argc > 1 && string(argv[1]) == "--include-file") {
+        if (argc < 4) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        std::vector<string> files(argv + 3, argv + argc);
+        return includeFile(argv[2], files) ? 0 : Ex_CantCreate;
+    }
+    if (argc > 1 && string(argv[1]) == "--object-cache-compile") {
+        if (argc < 5) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        std::vector<string> command(argv + 4, argv + argc);
+        return objectCacheCompile(argv[2], parseSize(argv[3]), command);
+    }
+    if (argc > 1 && string(argv[1]) == "--artifact-publish") {
+        if (argc != 5) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return publishArtifact(argv[2], argv[3], argv[4]) ? 0 : Ex_CantCreate;
+    }
+    if (argc > 1 && string(argv[1]) == "--artifact-fetch") {
+        if (argc != 6) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        char* end = nullptr;
+        long timeout = std::strtol(argv[5], &end, 10);
+        if (end == argv[5] || *end != '\0' || timeout < 0) {
+            std::clog << argv[0] << ": bad timeout for --artifact-fetch: " << argv[5] << endl;
+            return Ex_Usage;
+        }
+        return fetchArtifact(argv[2], argv[3], argv[4], timeout) ? 0 : Ex_NoInput;
+    }
+    if (argc > 1 && string(argv[1]) == "--dist-compile") {
+        if (argc < 4) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        std::vector<string> command(argv + 3, argv + argc);
+        return distCompile(argv[2], command);
+    }
+    if (argc > 1 && string(argv[1]) == "--dist-workers") {
+        unsigned long jobs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+        if (argc < 3 || argc > 4 || jobs == 0) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return distWorkers(argc == 4 ? argv[3] : string("127.0.0.1:") + defaultDistPort, jobs);
+    }
+    if (argc > 1 && string(argv[1]) == "--measure") {
+        if (argc < 6) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        std::vector<string> command(argv + 5, argv + argc);
+        return measureCommand(argv[2], argv[3], argv[4], command);
+    }
+    if (argc > 1 && string(argv[1]) == "--usage-summary") {
+        if (argc != 4) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return summarizeUsage(std::cout, argv[2], argv[3]) ? 0 : Ex_NoInput;
+    }
+    if (argc > 1 && string(argv[1]) == "--object-cache-stats") {
+        if (argc != 3) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return objectCacheStats(std::cout, argv[2]) ? 0 : Ex_NoInput;
+    }
+    if (argc > 1 && string(argv[1]) == "--object-cache-zero") {
+        if (argc != 3) {
+            usage(argv[0]);
+            return Ex_Usage;
+        }
+        return objectCacheZero(argv[2]) ? 0 : Ex_CantCreate;
+    }
+
     Bundle b;
 
     b.debug = false;
@@ -182,12 +515,86 @@ int main(int argc, char* argv[])
     b.project = {};
     b.inputpath = "ngen.json";
     b.outputpath = "build.ninja";
+    b.blastRadius = false;
+    b.blastRadiusMax = -1;
+    b.analyzeGraph = false;
+    b.graphPrefix = "ngen-graph";
+    b.analyzeLog = false;
+    b.analyzeLogTop = 10;
+    b.tracePath = "ngen-trace.json";
+    b.longestFirst = false;
+    b.recordUsage = false;
+    b.responseFileThreshold = 1000;
+    b.toplevel = true;
+    b.restatObjects = false;
+    b.bulkInstall = false;
+    b.objectCacheSize = uintmax_t(5) << 30;
+    b.shards = 0;
+    b.shardTimeout = 4 * 60 * 60;
+    b.artifacts = std::make_shared<std::map<string, string>>();
+    b.artifactKeys = std::make_shared<std::map<string, string>>();
+    b.onRequest = std::make_shared<std::set<string>>();
+    b.precompiledHeaders = std::make_shared<std::map<string, string>>();
 
     /* Parse options into bundle. */
     int rc = options(argc, argv, b);
     if (rc >= 0)
         return rc;
 
+    /*
+     * A relative path to ourself stops working after -C, one from $PATH doesn't.
+     */
+    b.self = b.argv[0];
+    bool absolute = b.self[0] == '/' || (b.self.size() > 1 && b.self[1] == ':');
+    if (b.self.find_first_of("/\\") != string::npos && !absolute)
+        b.self = pwd() + "/" + b.self;
+
+    /*
+     * Shards hand each other artifacts through the cache, so they need one.
+     * Another machine needs it somewhere shared.
+     */
+    if (b.shards > 0 && b.artifactCache.empty()) {
+        b.artifactCache = b.builddir + "/artifacts";
+        if (!b.directory.empty())
+            b.artifactCache = b.directory + "/" + b.artifactCache;
+    }
+
+    if (!b.artifactCache.empty()) {
+        bool absolute = b.artifactCache[0] == '/' || (b.artifactCache.size() > 1 && b.artifactCache[1] == ':');
+        if (!absolute)
+            b.artifactCache = pwd() + "/" + b.artifactCache;
+    }
+
+    /*
+     * The cache is a launcher that's built in. It's shared by every tree, so
+     * it's absolute.
+     */
+    if (!b.objectCache.empty()) {
+        bool absolute = b.objectCache[0] == '/' || (b.objectCache.size() > 1 && b.objectCache[1] == ':');
+        if (!absolute)
+            b.objectCache = pwd() + "/" + b.objectCache;
+        if (!b.launcher.empty())
+            std::clog << b.argv[0] << ": --object-cache replaces --launcher " << b.launcher << endl;
+        b.launcher = b.self + " --object-cache-compile " + b.objectCache + " " + std::to_string(b.objectCacheSize);
+    }
+
+    /*
+     * So is distribution. Hosts are checked now, rather than by every compile.
+     */
+    if (!b.distribute.empty()) {
+        std::vector<DistHost> hosts;
+        if (!parseDistHosts(b.distribute, hosts))
+            return Ex_Usage;
+        if (!b.objectCache.empty()) {
+            std::clog << b.argv[0] << ": --distribute replaces --object-cache " << b.objectCache << endl;
+            b.objectCache.clear();
+        } else if (!b.launcher.empty()) {
+            std::clog << b.argv[0] << ": --distribute replaces --launcher " << b.launcher << endl;
+        }
+        std::replace(b.distribute.begin(), b.distribute.end(), ' ', ',');
+        b.launcher = b.self + " --dist-compile " + b.distribute;
+    }
+
     if (!b.directory.empty()) {
         if (!cd(b.directory)) {
             std::clog << b.argv[0] << ": failed to change directory to " << b.directory << std::strerror(errno) << endl;
@@ -202,6 +609,11 @@ int main(int argc, char* argv[])
         return rc;
     }
 
+    if (b.shards > 0 && (!has(b.project, "type") || b.project.at("type") != "package")) {
+        std::clog << b.argv[0] << ": --shards only splits packages; generating it whole." << endl;
+        b.shards = 0;
+    }
+
     /* Only set if no -G ... */
     if (b.generatorname.empty())
         b.generatorname = defaultGenerator(b);
@@ -213,6 +625,61 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    /*
+     * History is optional. Without it longest first goes by file size.
+     */
+    if (b.longestFirst || b.shards > 0) {
+        string path = b.ninjaLogPath.empty() ? defaultNinjaLog(b.builddir) : b.ninjaLogPath;
+
+        if (std::ifstream(path)) {
+            b.history = std::make_shared<NinjaLog>();
+            if (!b.history->load(path))
+                b.history.reset();
+        } else if (b.debug) {
+            std::clog << "no " << path << ", scheduling by file size." << endl;
+        }
+    }
+
+    /*
+     * Usage is read whenever it's there: a tree measured once keeps its pools
+     * until the log is removed. Absolute, since exec edges cd first.
+     */
+    b.usagePath = defaultUsageLog(b.builddir);
+    if (b.usagePath[0] != '/' && (b.usagePath.size() < 2 || b.usagePath[1] != ':'))
+        b.usagePath = pwd() + "/" + b.usagePath;
+    if (std::ifstream(b.usagePath)) {
+        b.usage = std::make_shared<UsageLog>();
+        if (!b.usage->load(b.usagePath) || b.usage->empty())
+            b.usage.reset();
+        else
+            b.usage->compact(b.usagePath);
+    }
+
+    /*
+     * Remember what the old manifest would run before we overwrite it. With
+     * a limit, keep its files too, so going over it can put them back.
+     */
+    CommandHashes before;
+    bool haveBefore = false;
+    std::map<string, string> previous;
+
+    if (b.blastRadius) {
+        if (!b.commandHashesPath.empty())
+            haveBefore = loadCommandHashes(b.commandHashesPath, before);
+
+        bool limited = b.blastRadiusMax >= 0;
+        Manifest old;
+        if ((!haveBefore || limited) && std::ifstream(b.outputpath) && old.load(b.outputpath)) {
+            if (!haveBefore)
+                before = commandHashes(old);
+            haveBefore = true;
+            if (limited) {
+                for (const string& file : old.files())
+                    previous[file] = readFile(file);
+            }
+        }
+    }
+
     try {
         if (b.debug)
             std::clog << "generating " << b.project.at("project") << endl;
@@ -228,6 +695,58 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    b.output.close();
+
+    if (!b.blastRadius && !b.analyzeGraph && !b.analyzeLog)
+        return 0;
+
+    Manifest after;
+    if (!after.load(b.outputpath)) {
+        std::clog << b.argv[0] << ": cannot read back " << b.outputpath << endl;
+        return Ex_DataErr;
+    }
+
+    if (b.analyzeGraph) {
+        NinjaLog log;
+        bool haveLog = !b.ninjaLogPath.empty() && log.load(b.ninjaLogPath);
+
+        if (!analyzeGraph(std::cout, after, haveLog ? &log : nullptr, b.graphPrefix))
+            return Ex_CantCreate;
+    }
+
+    if (b.analyzeLog) {
+        string path = b.ninjaLogPath.empty() ? defaultNinjaLog(b.builddir) : b.ninjaLogPath;
+        NinjaLog log;
+
+        if (!log.load(path))
+            return Ex_NoInput;
+        if (!analyzeLog(std::cout, after, log, b.analyzeLogTop, b.tracePath))
+            return Ex_CantCreate;
+    }
+
+    if (b.blastRadius) {
+        if (!haveBefore) {
+            std::cout << b.argv[0] << ": no previous manifest or command hashes to compare with." << endl;
+        } else {
+            size_t count = reportBlastRadius(std::cout, before, after);
+
+            if (b.blastRadiusMax >= 0 && count > static_cast<size_t>(b.blastRadiusMax)) {
+                std::clog << b.argv[0] << ": " << count << " edges invalidated, more than --blast-radius-max "
+                    << b.blastRadiusMax << "; keeping the old " << b.outputpath << endl;
+                restoreManifest(after, previous);
+                return 1;
+            }
+        }
+
+        /*
+         * Only once it's kept, so the next run compares with what's built.
+         */
+        if (!b.commandHashesPath.empty() && !saveCommandHashes(b.commandHashesPath, commandHashes(after))) {
+            std::clog << b.argv[0] << ": cannot create " << b.commandHashesPath << endl;
+            return Ex_CantCreate;
+        }
+    }
+
     return 0;
 }
 
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "modules.hpp"
+
+#include "path.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+using json = nlohmann::json;
+using std::endl;
+using std::string;
+using list = std::vector<std::string>;
+
+bool isModuleInterface(const string& source)
+{
+    string ext = extension(source);
+
+    return ext == ".cppm" || ext == ".ixx" || ext == ".mpp" || ext == ".c++m";
+}
+
+
+/*
+ * Escape a path for a ninja build line.
+ */
+static string escape(const string& path)
+{
+    string r;
+
+    for (char c : path) {
+        if (c == '$' || c == ' ' || c == ':')
+            r.push_back('$');
+        r.push_back(c);
+    }
+
+    return r;
+}
+
+
+/*
+ * A partition like foo:bar can't be in a file name everywhere.
+ */
+static string bmi(const string& gcmdir, const string& module)
+{
+    string name = module;
+
+    for (char& c : name) {
+        if (c == ':')
+            c = '-';
+    }
+
+    return gcmdir + "/" + name + ".gcm";
+}
+
+
+static bool writeIfChanged(const string& path, const string& content)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        std::ostringstream old;
+        old << in.rdbuf();
+        if (old.str() == content)
+            return true;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::clog << "cannot create " << path << endl;
+        return false;
+    }
+    out << content;
+
+    return static_cast<bool>(out);
+}
+
+
+bool collateModules(const string& dyndep, const string& mapper, const string& gcmdir, const list& ddis)
+{
+    list files;
+
+    for (const string& arg : ddis) {
+        if (arg.empty() || arg[0] != '@') {
+            files.push_back(arg);
+            continue;
+        }
+
+        std::ifstream rsp(arg.substr(1));
+        if (!rsp) {
+            std::clog << "cannot open response file: " << arg.substr(1) << endl;
+            return false;
+        }
+        string name;
+        while (rsp >> name)
+            files.push_back(name);
+    }
+
+    struct Unit
+    {
+        string object;
+        list provides;
+        list imports;
+    };
+
+    std::vector<Unit> units;
+    std::map<string, string> providers;
+
+    for (const string& file : files) {
+        std::ifstream in(file);
+        if (!in) {
+            std::clog << "cannot open scan result: " << file << endl;
+            return false;
+        }
+
+        try {
+            json ddi = json::parse(in);
+
+            for (const json& rule : ddi.at("rules")) {
+                Unit unit{ rule.at("primary-output"), {}, {} };
+
+                if (rule.contains("provides")) {
+                    for (const json& p : rule.at("provides")) {
+                        string name = p.at("logical-name");
+                        auto it = providers.find(name);
+                        if (it != providers.cend()) {
+                            std::clog << file << ": module " << name << " is also provided by " << it->second << endl;
+                            return false;
+                        }
+                        providers[name] = unit.object;
+                        unit.provides.push_back(name);
+                    }
+                }
+                if (rule.contains("requires")) {
+                    for (const json& r : rule.at("requires"))
+                        unit.imports.push_back(r.at("logical-name"));
+                }
+
+                units.push_back(unit);
+            }
+        } catch (std::exception& ex) {
+            std::clog << file << ": " << ex.what() << endl;
+            return false;
+        }
+    }
+
+    std::ostringstream dd;
+    dd << "ninja_dyndep_version = 1" << endl;
+
+    for (const Unit& unit : units) {
+        dd << "build " << escape(unit.object);
+        if (!unit.provides.empty()) {
+            dd << " |";
+            for (const string& name : unit.provides)
+                dd << " " << escape(bmi(gcmdir, name));
+        }
+        dd << " : dyndep";
+
+        bool first = true;
+        for (const string& name : unit.imports) {
+            if (providers.find(name) == providers.cend())
+                continue;
+            dd << (first ? " | " : " ") << escape(bmi(gcmdir, name));
+            first = false;
+        }
+        dd << endl;
+    }
+
+    /*
+     * Relative to where ninja runs, like everything else.
+     */
+    std::ostringstream map;
+    map << "$root ." << endl;
+    for (const auto& provider : providers)
+        map << provider.first << " " << bmi(gcmdir, provider.first) << endl;
+
+    return writeIfChanged(mapper, map.str()) && writeIfChanged(dyndep, dd.str());
+}
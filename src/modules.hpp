@@ -0,0 +1,51 @@
+#ifndef NGEN_MODULES__HPP
+#define NGEN_MODULES__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * C++20 modules: collating P1689 scan results into a ninja dyndep file.
+ */
+
+#include <string>
+#include <vector>
+
+/** Returns if source is a module interface unit by its extension.
+ *
+ * .cppm, .ixx, .mpp, and .c++m.
+ */
+bool isModuleInterface(const std::string& source);
+
+/** Collate the P1689r5 files from scanning a project's sources.
+ *
+ * Writes dyndep, which gives each object the BMI it provides as an implicit
+ * output and the BMIs it imports as implicit inputs, so ninja builds
+ * modules before their importers. Writes mapper, a GCC module mapper file
+ * for the same BMI paths. Imports of modules the project doesn't provide are
+ * left for the compiler to find.
+ *
+ * Files are only written when their content changes.
+ *
+ * @param gcmdir where the BMIs go.
+ * @param ddis the scan results. An argument of @file is replaced by the
+ * whitespace separated names in file, like a ninja response file.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool collateModules(const std::string& dyndep, const std::string& mapper, const std::string& gcmdir,
+                    const std::vector<std::string>& ddis);
+
+#endif // NGEN_MODULES__HPP
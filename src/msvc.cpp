@@ -19,6 +19,11 @@
 #include "Bundle.hpp"
 #include "Statement.hpp"
 #include "path.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
 
 using std::endl;
 using std::quoted;
@@ -57,6 +62,7 @@ bool msvc::generateVariables(const json& project)
         << "# Microsoft Visual C++ compiler." << endl
         << "cc  = cmd /C cl.exe" << endl
         << "cxx = cmd /C cl.exe" << endl
+        << "lib = cmd /C lib.exe" << endl
         << "make = cmd /C nmake.exe" << endl
         << endl
         ;
@@ -124,20 +130,21 @@ bool msvc::generateRules()
         ;
 
     // XXX: ldflags would usually be more applicable to running link than cl, and using cflags should be safe here.
-    output()
-        << "# link *.obj -> *.exe" << endl
-        << "rule c_application" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cc /nologo /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs" << endl
-        << endl
-        ;
-    output()
-        << "# link *.obj -> *.dll" << endl
-        << "rule c_library" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cc /nologo /LD /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs " << endl
-        << endl
-        ;
+    generateRuleWithResponseFile("link *.obj -> *.exe", "c_application", "LD $in -> $out", "link_pool",
+                                 "$cc /nologo /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs");
+    generateRuleWithResponseFile("link *.obj -> *.dll", "c_library", "LD $in -> $out", "link_pool",
+                                 "$cc /nologo /LD /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs");
+
+    /*
+     * Static libraries.
+     */
+
+    generateRuleWithResponseFile("archive *.obj -> *.lib", "c_static_library", "LIB $out", "",
+                                 "$lib /nologo /OUT:$out $in");
+    generateRuleWithResponseFile("archive *.obj -> *.lib", "cxx_static_library", "LIB $out", "",
+                                 "$lib /nologo /OUT:$out $in");
+    generateRuleWithResponseFile("archive *.obj -> *.lib for installing", "install_archive", "INSTALL $out", "",
+                                 "$lib /nologo /OUT:$out $in");
 
     /*
      * CXX programs
@@ -153,20 +160,10 @@ bool msvc::generateRules()
         ;
 
     // XXX: same note as c_application
-    output()
-        << "# link *.obj -> *.exe" << endl
-        << "rule cxx_application" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cxx /nologo /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs" << endl
-        << endl
-        ;
-    output()
-        << "# link *.obj -> *.dll" << endl
-        << "rule cxx_library" << endl
-        << indent << "description = LD $in -> $out" << endl
-        << indent << "command = $cxx /nologo /LD /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs"
-        << endl
-        ;
+    generateRuleWithResponseFile("link *.obj -> *.exe", "cxx_application", "LD $in -> $out", "link_pool",
+                                 "$cxx /nologo /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs");
+    generateRuleWithResponseFile("link *.obj -> *.dll", "cxx_library", "LD $in -> $out", "link_pool",
+                                 "$cxx /nologo /LD /Fd$builddir/$pdb /Fe$out $in $ldflags $ldlibs");
 
     return true;
 }
@@ -178,6 +175,9 @@ bool msvc::generateBuildStatementsForLibrary(const json& project, const string&
         return false;
     }
 
+    if (!buildsSharedLibrary(project, type))
+        return true;
+
 
     string built_dll = builddir(libraryBase());
     string built_implib = "$builddir/$libdir/$implib";
@@ -229,7 +229,7 @@ msvc::list msvc::extraInputsForTargetName(const json& project, const string& typ
 {
     list r = cxxbase::extraInputsForTargetName(project, type, rule);
 
-    if (isLibraryType(type)) {
+    if (buildsSharedLibrary(project, type)) {
         r.push_back("$distdir/$library/$implib");
         r.push_back("$distdir/$library/$exp");
     }
@@ -238,6 +238,53 @@ msvc::list msvc::extraInputsForTargetName(const json& project, const string& typ
 }
 
 
+msvc::string msvc::linkArtifact(const json& project, const string& type) const
+{
+    /*
+     * Dependents link with the import library, not the .dll.
+     */
+    if (buildsSharedLibrary(project, type))
+        return builddir("$libdir/" + targetName() + ".lib");
+
+    return cxxbase::linkArtifact(project, type);
+}
+
+
+msvc::string msvc::librarySearchFlags(const list& dirs) const
+{
+    /*
+     * These are for link.exe, so they go after the /link in $ldflags, or
+     * after one of our own when there isn't one.
+     */
+    string ldflags;
+    const json& project = projectData();
+    if (has(project, generatorName()) && has(project.at(generatorName()), "ldflags")) {
+        const json& flags = project.at(generatorName()).at("ldflags");
+        if (flags.is_array()) {
+            for (const string& word : flags)
+                ldflags += " " + word;
+        } else {
+            ldflags = " " + flags.get<string>();
+        }
+    }
+
+    std::istringstream words(ldflags);
+    string word;
+    bool linking = false;
+    while (words >> word) {
+        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+        linking = linking || word == "/link" || word == "-link";
+    }
+
+    string r = linking ? "$ldflags" : "$ldflags /link";
+
+    for (const string& dir : dirs)
+        r += " /libpath:" + dir;
+
+    return r;
+}
+
+
 msvc::string msvc::objectExtension() const
 {
     /*
@@ -263,6 +310,21 @@ msvc::string msvc::libraryPrefix() const
 }
 
 
+msvc::string msvc::staticLibraryPrefix() const
+{
+    /*
+     * Like Boost: libfoo.lib is static, foo.lib is foo.dll's import library.
+     */
+    return "lib";
+}
+
+
+msvc::string msvc::staticLibraryExtension() const
+{
+    return ".lib";
+}
+
+
 msvc::string msvc::libraryExtension() const
 {
     /*
@@ -42,6 +42,10 @@ class msvc : public cxxbase
     string applicationExtension() const override;
     string libraryPrefix() const override;
     string libraryExtension() const override;
+    string staticLibraryPrefix() const override;
+    string staticLibraryExtension() const override;
+    string linkArtifact(const json& project, const string& type) const override;
+    string librarySearchFlags(const list& dirs) const override;
 
   private:
 };
@@ -0,0 +1,526 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "objectcache.hpp"
+
+#include "filesystem.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#if defined(__linux__)
+extern "C" {
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+}
+#endif
+
+namespace fs = std::filesystem;
+using std::endl;
+using std::string;
+using list = std::vector<std::string>;
+
+
+/*
+ * What a compile command reads and writes.
+ */
+struct CompileCommand
+{
+    string input;
+    string output;
+    /** argv less the output, depfile, and input: what goes in the key. */
+    list flags;
+};
+
+
+/*
+ * Options whose value is the next argument.
+ */
+static bool takesValue(const string& arg)
+{
+    static const char* options[] = {
+        "-o", "-MF", "-MT", "-MQ", "-x", "-include", "-imacros", "-I", "-isystem",
+        "-iquote", "-idirafter", "-D", "-U", "-Xpreprocessor", "-Xassembler",
+    };
+
+    for (const char* option : options) {
+        if (arg == option)
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Returns the part of a -f*-prefix-map=OLD=NEW option after OLD, or arg if
+ * it's not one.
+ */
+static string prefixMapped(const string& arg, string& old)
+{
+    static const char* options[] = {
+        "-ffile-prefix-map=", "-fdebug-prefix-map=", "-fmacro-prefix-map=", "-fprofile-prefix-map=",
+    };
+
+    for (const char* option : options) {
+        string name = option;
+        if (arg.compare(0, name.size(), name) != 0)
+            continue;
+
+        size_t equals = arg.find('=', name.size());
+        old = arg.substr(name.size(), equals == string::npos ? string::npos : equals - name.size());
+        return name + (equals == string::npos ? "" : arg.substr(equals));
+    }
+
+    return arg;
+}
+
+
+static bool parseCommand(const list& argv, CompileCommand& cmd)
+{
+    bool compile = false;
+    bool debugInfo = false;
+    bool mapsCwd = false;
+    size_t inputs = 0;
+    string cwd = fs::current_path().string();
+
+    cmd.flags.push_back(argv.front());
+
+    for (size_t i=1; i < argv.size(); ++i) {
+        const string& arg = argv[i];
+
+        /*
+         * Modules write a .gcm, and split DWARF a .dwo, beside the object.
+         * The cache only has room for the object.
+         */
+        if (arg.compare(0, 8, "-fmodule") == 0 || arg == "-gsplit-dwarf")
+            return false;
+
+        string old;
+        string mapped = prefixMapped(arg, old);
+
+        if (mapped != arg) {
+            /*
+             * Where the tree is isn't in the key, only what it's mapped to,
+             * so trees that map themselves to the same place share entries.
+             */
+            bool debugMap = arg.find("-fmacro-prefix-map=") != 0;
+            if (debugMap && !old.empty() && cwd.compare(0, old.size(), old) == 0)
+                mapsCwd = true;
+            cmd.flags.push_back(mapped);
+        } else if (takesValue(arg) && i + 1 < argv.size()) {
+            const string& value = argv[++i];
+
+            if (arg == "-o") {
+                cmd.output = value;
+            } else if (arg != "-MF" && arg != "-MT" && arg != "-MQ") {
+                cmd.flags.push_back(arg);
+                cmd.flags.push_back(value);
+            }
+        } else if (arg == "-c") {
+            compile = true;
+            cmd.flags.push_back(arg);
+        } else if (arg.empty() || arg[0] != '-') {
+            cmd.input = arg;
+            ++inputs;
+        } else {
+            if (arg.compare(0, 2, "-g") == 0)
+                debugInfo = arg != "-g0";
+            cmd.flags.push_back(arg);
+        }
+    }
+
+    /*
+     * Debug info names the directory it was compiled in, unless a prefix
+     * map takes that out.
+     */
+    if (debugInfo && !mapsCwd)
+        cmd.flags.push_back("cwd=" + cwd);
+
+    return compile && inputs == 1 && !cmd.output.empty();
+}
+
+
+static void record(const string& store, const string& event)
+{
+    /*
+     * One short append per compile, so parallel writers don't interleave.
+     */
+    std::ofstream stats(store + "/stats", std::ios::app);
+    stats << event << "\n";
+}
+
+
+/*
+ * Clone from to to, if the filesystem has reflinks. The clone is a file of
+ * its own, that only shares blocks with from.
+ */
+static bool reflink(const fs::path& from, const fs::path& to)
+{
+#if defined(__linux__) && defined(FICLONE)
+    std::error_code ec;
+
+    int in = open(from.c_str(), O_RDONLY);
+    if (in >= 0) {
+        int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0444);
+        bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+        if (out >= 0)
+            close(out);
+        close(in);
+        if (cloned)
+            return true;
+        fs::remove(to, ec);
+    }
+#else
+    (void)from;
+    (void)to;
+#endif
+
+    return false;
+}
+
+
+/*
+ * reflink(), or else a hardlink. Returns false for neither.
+ */
+static bool link(const fs::path& from, const fs::path& to)
+{
+    std::error_code ec;
+
+    if (reflink(from, to))
+        return true;
+
+    fs::create_hard_link(from, to, ec);
+
+    return !ec;
+}
+
+
+/*
+ * Returns where entry's last use is kept.
+ *
+ * Not the entry's own time: it's hardlinked into the builddir that added
+ * it, and touching it would make that tree's object newer than what was
+ * linked from it.
+ */
+static fs::path usedPath(const fs::path& entry)
+{
+    fs::path r = entry;
+    return r.replace_extension(".used");
+}
+
+
+static void touch(const fs::path& path)
+{
+    std::error_code ec;
+
+    std::ofstream(path, std::ios::app);
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+}
+
+
+/*
+ * Evict the least recently used entries, down to 90% of maxBytes. Only one
+ * process trims at a time; the rest carry on.
+ */
+static void trim(const fs::path& store, uintmax_t maxBytes)
+{
+    std::error_code ec;
+    fs::path lock = store / "trim.lock";
+
+    if (!fs::create_directory(lock, ec)) {
+        auto age = fs::file_time_type::clock::now() - fs::last_write_time(lock, ec);
+        if (ec || age < std::chrono::hours(1))
+            return;
+        /* Left by a trim that died. */
+        fs::remove(lock, ec);
+        if (!fs::create_directory(lock, ec))
+            return;
+    }
+
+    struct Entry
+    {
+        fs::file_time_type time;
+        uintmax_t size;
+        fs::path path;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    auto stale = fs::file_time_type::clock::now() - std::chrono::hours(1);
+
+    for (auto& dir : fs::directory_iterator(store, ec)) {
+        if (!dir.is_directory(ec) || dir.path() == lock)
+            continue;
+
+        for (auto& file : fs::directory_iterator(dir.path(), ec)) {
+            Entry entry{ file.last_write_time(ec), file.file_size(ec), file.path() };
+
+            if (dir.path().filename() == "tmp") {
+                if (entry.time < stale)
+                    fs::remove(entry.path, ec);
+                continue;
+            }
+
+            /*
+             * Used since it was added, or else as old as it is.
+             */
+            if (entry.path.extension() == ".used") {
+                if (!fs::exists(fs::path(entry.path).replace_extension(".o"), ec))
+                    fs::remove(entry.path, ec);
+                continue;
+            }
+
+            fs::file_time_type used = fs::last_write_time(usedPath(entry.path), ec);
+            if (!ec && used > entry.time)
+                entry.time = used;
+
+            entries.push_back(entry);
+            total += entry.size;
+        }
+    }
+
+    if (total > maxBytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.time < b.time;
+        });
+
+        uintmax_t target = maxBytes / 10 * 9;
+        for (const Entry& entry : entries) {
+            if (total <= target)
+                break;
+            if (fs::remove(entry.path, ec))
+                total -= entry.size;
+            fs::remove(usedPath(entry.path), ec);
+        }
+    }
+
+    fs::remove(lock, ec);
+}
+
+
+int objectCacheCompile(const string& store, uintmax_t maxBytes, const list& command)
+{
+    if (command.empty())
+        return 1;
+
+    std::error_code ec;
+    fs::create_directories(fs::path(store) / "tmp", ec);
+
+    CompileCommand cmd;
+    if (!parseCommand(command, cmd)) {
+        record(store, "uncacheable");
+        return runCommand(command);
+    }
+
+    /*
+     * Preprocess with the same flags, which also writes the depfile a hit
+     * needs. -MT, since it would otherwise name the .i. With -g the .i
+     * starts with the working directory; parseCommand() keys that when it
+     * matters, so it's left out here.
+     */
+
+    auto given = [&command](const char* arg) {
+        return std::find(command.cbegin(), command.cend(), arg) != command.cend();
+    };
+
+    list target;
+    if ((given("-MD") || given("-MMD")) && !given("-MT"))
+        target = { "-MT", cmd.output };
+
+    string preprocessed = temporaryName(cmd.output);
+    list preprocess = { command.front(), "-fno-working-directory" };
+    preprocess.insert(preprocess.end(), target.cbegin(), target.cend());
+
+    for (size_t i=1; i < command.size(); ++i) {
+        if (command[i] == "-c") {
+            preprocess.push_back("-E");
+        } else if (command[i] == "-o" && i + 1 < command.size()) {
+            preprocess.push_back("-o");
+            preprocess.push_back(preprocessed);
+            ++i;
+        } else {
+            preprocess.push_back(command[i]);
+        }
+    }
+
+    if (runCommand(preprocess) != 0) {
+        fs::remove(preprocessed, ec);
+        record(store, "uncacheable");
+        return runCommand(command);
+    }
+
+    string data = toolIdentity(command.front());
+    for (const string& flag : cmd.flags)
+        data += '\0' + flag;
+    data += '\0' + readFile(preprocessed);
+    fs::remove(preprocessed, ec);
+
+    string key = sha256(data);
+    fs::path entry = fs::path(store) / key.substr(0, 2) / (key + ".o");
+
+    if (fs::exists(entry, ec)) {
+        fs::remove(cmd.output, ec);
+
+        /*
+         * Never a hardlink: the object has to be newer than its inputs,
+         * without changing the time of every other tree's copy.
+         */
+        if (reflink(entry, cmd.output) || fs::copy_file(entry, cmd.output, ec)) {
+            fs::last_write_time(cmd.output, fs::file_time_type::clock::now(), ec);
+            touch(usedPath(entry));
+            record(store, "hit");
+            return 0;
+        }
+    }
+
+    /*
+     * Compile to the side and rename, so a hardlink from an earlier hit is
+     * replaced rather than written through into the store.
+     */
+
+    string object = temporaryName(cmd.output);
+    list compile = command;
+    for (size_t i=1; i + 1 < compile.size(); ++i) {
+        if (compile[i] == "-o")
+            compile[i + 1] = object;
+    }
+    compile.insert(compile.begin() + 1, target.cbegin(), target.cend());
+
+    int rc = runCommand(compile);
+    if (rc != 0) {
+        fs::remove(object, ec);
+        return rc;
+    }
+
+    fs::rename(object, cmd.output, ec);
+    if (ec) {
+        std::clog << "cannot rename " << object << " to " << cmd.output << ": " << ec.message() << endl;
+        return 1;
+    }
+
+    record(store, "miss");
+
+    /*
+     * Adding it is best effort: a failure is only a miss next time.
+     */
+
+    fs::path tmp = temporaryName((fs::path(store) / "tmp" / key).string());
+    if (!link(cmd.output, tmp) && !fs::copy_file(cmd.output, tmp, ec))
+        return 0;
+
+    fs::permissions(tmp, fs::perms::owner_read | fs::perms::group_read | fs::perms::others_read, ec);
+    fs::create_directories(entry.parent_path(), ec);
+    fs::rename(tmp, entry, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+
+    /*
+     * Trim about once every 32 misses, rather than walking the store for
+     * every one.
+     */
+    if (maxBytes > 0 && (fnv1a(key) & 31) == 0)
+        trim(store, maxBytes);
+
+    return 0;
+}
+
+
+bool objectCacheStats(std::ostream& out, const string& store)
+{
+    std::error_code ec;
+
+    if (!fs::is_directory(store, ec)) {
+        std::clog << "no object cache at " << store << endl;
+        return false;
+    }
+
+    std::map<string, uintmax_t> counts;
+    std::ifstream stats(store + "/stats");
+    string event;
+    while (std::getline(stats, event))
+        counts[event]++;
+
+    uintmax_t entries = 0;
+    uintmax_t bytes = 0;
+    for (auto& file : fs::recursive_directory_iterator(store, ec)) {
+        if (!file.is_regular_file(ec) || file.path().extension() != ".o")
+            continue;
+        if (file.path().parent_path().filename() == "tmp")
+            continue;
+        ++entries;
+        bytes += file.file_size(ec);
+    }
+
+    uintmax_t lookups = counts["hit"] + counts["miss"];
+
+    out << "cache directory " << store << endl
+        << "hits            " << counts["hit"] << endl
+        << "misses          " << counts["miss"] << endl
+        << "uncacheable     " << counts["uncacheable"] << endl
+        << "hit rate        " << (lookups == 0 ? 0 : counts["hit"] * 100 / lookups) << "%" << endl
+        << "entries         " << entries << endl
+        << "size            " << bytes << " bytes" << endl
+        ;
+
+    return true;
+}
+
+
+bool objectCacheZero(const string& store)
+{
+    std::ofstream stats(store + "/stats", std::ios::trunc);
+
+    if (!stats) {
+        std::clog << "cannot zero " << store << "/stats" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+uintmax_t parseSize(const string& size)
+{
+    char* end = nullptr;
+    unsigned long long n = std::strtoull(size.c_str(), &end, 10);
+
+    if (end == size.c_str())
+        return 0;
+
+    switch (*end) {
+        case '\0':
+            return n;
+        case 'k': case 'K':
+            return n << 10;
+        case 'm': case 'M':
+            return n << 20;
+        case 'g': case 'G':
+            return n << 30;
+        case 't': case 'T':
+            return n << 40;
+    }
+
+    return 0;
+}
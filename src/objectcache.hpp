@@ -0,0 +1,62 @@
+#ifndef NGEN_OBJECTCACHE__HPP
+#define NGEN_OBJECTCACHE__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A local object cache, for gcc's compiles to run through.
+ *
+ * Objects are stored by a hash of the preprocessed source, the compiler,
+ * and the flags, in a directory that can be shared by trees and machines.
+ */
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/** Run the compile in command through the cache in store.
+ *
+ * On a hit the object is reflinked or copied from store, and the entry's
+ * .used file beside it touched. On a miss it is compiled and added to
+ * store, hardlinked where it can be, and store is then trimmed to maxBytes
+ * now and again, by when entries were last used. Commands that aren't a
+ * single -c source to -o object are run as they are.
+ *
+ * Entries are added by renaming them into place, so parallel compiles can
+ * share a store. They are read only, since they may be a hardlink.
+ *
+ * @returns the exit status of the compile.
+ */
+int objectCacheCompile(const std::string& store, uintmax_t maxBytes, const std::vector<std::string>& command);
+
+/** Write hits, misses, and the size of store to out.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool objectCacheStats(std::ostream& out, const std::string& store);
+
+/** Zero store's statistics.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool objectCacheZero(const std::string& store);
+
+/** Returns size, like 5G or 500M, in bytes; 0 if it isn't one.
+ */
+uintmax_t parseSize(const std::string& size);
+
+#endif // NGEN_OBJECTCACHE__HPP
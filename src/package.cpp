@@ -17,12 +17,47 @@
 #include "package.hpp"
 
 #include "Bundle.hpp"
+#include "Manifest.hpp"
+#include "artifactcache.hpp"
+#include "filesystem.hpp"
 #include "Statement.hpp"
 #include "path.hpp"
 #include "util.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+
 using std::endl;
 using std::quoted;
+using std::string;
+
+/*
+ * What manifest installs, relative to distdir. Reading it back gets that for
+ * any backend, with the paths expanded.
+ */
+static bool installedFiles(const string& manifest, const string& distdir, package::list& files)
+{
+    Manifest generated;
+    if (!generated.load(manifest))
+        return false;
+
+    string prefix = lexically_normal(distdir) + "/";
+
+    for (const Manifest::Edge& edge : generated.edges()) {
+        for (const package::list* outputs : { &edge.outputs, &edge.implicitOutputs }) {
+            for (const string& output : *outputs) {
+                if (output.compare(0, prefix.size(), prefix) == 0)
+                    files.push_back(output.substr(prefix.size()));
+            }
+        }
+    }
+
+    return true;
+}
+
 
 package::package(Bundle& bundle)
     : Shinobi(bundle)
@@ -46,14 +81,38 @@ bool package::generateBuildStatementsForObjects(const json& project, const strin
      * than source files.
      */
 
-    for (const string& source : project.at("sources")) {
+    list children = project.at("sources");
+
+    if (bundle().longestFirst && bundle().history) {
+        /*
+         * Whichever child took the longest last time goes first, so ninja gets
+         * its link started early rather than as the tail of the build.
+         */
+        const NinjaLog& history = *bundle().history;
+        string top = lexically_normal(bundle().builddir);
+
+        std::stable_sort(children.begin(), children.end(), [&](const string& a, const string& b) {
+            return history.totalDuration(top + "/" + a + "/") > history.totalDuration(top + "/" + b + "/");
+        });
+    }
+
+    if (bundle().toplevel && bundle().shards > 0)
+        return generateShards(project, children);
+
+    /*
+     * Libraries are generated before the children that depend on them, so
+     * those know what to link with. The subninjas stay in schedule order.
+     */
+    for (const string& source : generationOrder(project.at("sources"))) {
 
         /*
          * It's expected that each of these will generate a phony for 'source'.
          */
 
         generateChildProject(source);
+    }
 
+    for (const string& source : children) {
         output() << "subninja " << sourcedir(source) << "/build.ninja" << endl;
     }
 
@@ -61,6 +120,63 @@ bool package::generateBuildStatementsForObjects(const json& project, const strin
 }
 
 
+package::json package::childProject(const string& child) const
+{
+    string path = bundle().sourcedir + "/" + child + "/" + filename(bundle().inputpath);
+    std::ifstream in(path);
+    json project;
+
+    try {
+        in >> project;
+    } catch (std::exception&) {
+        /* generateChildProject() will say what's wrong with it. */
+        return nullptr;
+    }
+
+    return project;
+}
+
+
+package::list package::generationOrder(const list& children) const
+{
+    /*
+     * Dependencies name projects, and children are directories.
+     */
+    std::map<string, string> byName;
+    std::map<string, list> dependencies;
+
+    for (const string& child : children) {
+        json project = childProject(child);
+
+        if (has(project, "project"))
+            byName[project.at("project")] = child;
+        if (has(project, "dependencies"))
+            dependencies[child] = project.at("dependencies").get<list>();
+    }
+
+    list r;
+    std::set<string> visited;
+
+    std::function<void(const string&)> visit = [&](const string& child) {
+        if (!visited.insert(child).second)
+            return;
+
+        for (const string& name : dependencies[child]) {
+            auto it = byName.find(name);
+            if (it != byName.cend())
+                visit(it->second);
+        }
+
+        r.push_back(child);
+    };
+
+    for (const string& child : children)
+        visit(child);
+
+    return r;
+}
+
+
 bool package::generateBuildStatementsForPackage(const json& project, const string& type, const string& rule)
 {
     if (!Shinobi::generateBuildStatementsForPackage(project, type, rule)) {
@@ -84,7 +200,7 @@ bool package::generateBuildStatementsForPackage(const json& project, const strin
 }
 
 
-bool package::generateChildProject(const string& name)
+bool package::generateChildProject(const string& name, long shard)
 {
     if (debug())
         log() << "generateChildProject(): name: " << name << endl;
@@ -105,6 +221,34 @@ bool package::generateChildProject(const string& name)
     child.distribution = bundle().distribution;
     child.project = {};
 
+    child.longestFirst = bundle().longestFirst;
+    child.history = bundle().history;
+    child.recordUsage = bundle().recordUsage;
+    child.usagePath = bundle().usagePath;
+    child.usage = bundle().usage;
+    child.launcher = bundle().launcher;
+    child.lto = bundle().lto;
+    child.linker = bundle().linker;
+    child.responseFileThreshold = bundle().responseFileThreshold;
+    child.toplevel = false;
+    child.self = bundle().self;
+    child.restatObjects = bundle().restatObjects;
+    child.bulkInstall = bundle().bulkInstall;
+    child.objectCache = bundle().objectCache;
+    child.objectCacheSize = bundle().objectCacheSize;
+    child.distribute = bundle().distribute;
+    child.artifacts = bundle().artifacts;
+    child.artifactCache = bundle().artifactCache;
+    child.artifactKeys = bundle().artifactKeys;
+    child.onRequest = bundle().onRequest;
+    child.precompiledHeaders = bundle().precompiledHeaders;
+
+    if (shard >= 0) {
+        child.builddir = shardDir(shard) + "/" + name;
+        child.distdir = shardDir(shard) + "/dist";
+        child.artifacts = mShardArtifacts.at(shard);
+    }
+
     /*
      * This should probably be an environment variable that defaults to
      * ngen.json. Rather than reusing -f foo.
@@ -122,8 +266,533 @@ bool package::generateChildProject(const string& name)
     logBundle(log(), child, "DEBUG CHILD BUNDLE FOR: " + name);
 
     child.generatorname = defaultGenerator(child);
+
+    string key;
+    if (!bundle().artifactCache.empty()) {
+        key = artifactKey(child);
+
+        if (!key.empty()) {
+            (*bundle().artifactKeys)[child.project.at("project")] = key;
+
+            json manifest = findArtifact(bundle().artifactCache, key);
+            if (!manifest.is_null()) {
+                mPublished[child.project.at("project")] = manifest;
+                return generateRestoredChild(child, key, manifest);
+            }
+        }
+    }
+
     child.generator = makeGenerator(child.generatorname, child);
 
-    return child.generator->generate();
+    if (!child.generator->generate())
+        return false;
+
+    if (key.empty())
+        return true;
+
+    child.output.close();
+    return generatePublish(child, key);
+}
+
+
+package::string package::artifactKey(const Bundle& child) const
+{
+    const json& project = child.project;
+    string type = has(project, "type") ? project.at("type").get<string>() : "";
+
+    if (!isApplicationType(type) && !isLibraryType(type))
+        return "";
+
+    string data = "ngen artifact 1\n" + child.generatorname + "\n";
+
+    /*
+     * What the backend runs; it hardcodes the names.
+     */
+    static const std::map<string, list> toolchains = {
+        { "gcc", { "gcc", "g++", "ar" } },
+        { "msvc", { "cl.exe", "link.exe", "lib.exe" } },
+        { "javac", { "javac", "jar" } },
+    };
+    auto tools = toolchains.find(child.generatorname);
+    if (tools != toolchains.cend()) {
+        for (const string& tool : tools->second)
+            data += toolIdentity(tool) + "\n";
+    }
+
+    data += child.distribution.dump() + "\n"
+        + child.lto + "\n"
+        + child.linker + "\n"
+        + treeDigest(child.sourcedir);
+
+    if (has(project, "dependencies")) {
+        for (const string& name : project.at("dependencies")) {
+            auto it = bundle().artifactKeys->find(name);
+            if (it == bundle().artifactKeys->cend()) {
+                if (debug())
+                    log() << "not caching " << project.at("project") << ", " << name << " isn't cached" << endl;
+                return "";
+            }
+            data += name + " " + it->second + "\n";
+        }
+    }
+
+    return sha256(data);
+}
+
+
+bool package::generateRestoredChild(Bundle& child, const string& key, const json& manifest, bool fetch)
+{
+    if (debug())
+        log() << (fetch ? "fetching " : "restoring ") << child.project.at("project") << " from artifact " << key << endl;
+
+    std::ofstream out(child.outputpath);
+    if (!out) {
+        error() << "cannot create " << child.outputpath << endl;
+        return false;
+    }
+
+    string target = manifest.at("target");
+    string type = manifest.at("type");
+    string files = artifactFiles(bundle().artifactCache, key);
+
+    out
+        << "# Generated by ngen: " << target << (fetch ? " fetched" : " restored")
+        << " from the artifact cache, key " << key << "." << endl
+        << endl
+        << "sourcedir = " << child.sourcedir << endl
+        << "builddir = " << child.builddir << endl
+        << "distdir = " << child.distdir << endl
+        << endl
+        ;
+
+    Statement all("phony");
+
+    if (fetch) {
+        out
+            << "# fetch the files from the artifact cache, once a shard has published them" << endl
+            << "rule artifact_fetch" << endl
+            << "    description = FETCH " << target << endl
+            << "    command = " << bundle().self << " --artifact-fetch " << bundle().artifactCache << " $key $distdir "
+            << bundle().shardTimeout << endl
+            << endl
+            ;
+
+        Statement fetched("artifact_fetch");
+
+        for (const string& file : manifest.at("files")) {
+            fetched.appendOutput(distdir(file));
+            all.appendInput(distdir(file));
+        }
+        fetched.appendVariable("key", key);
+
+        if (!manifest.at("files").empty())
+            out << fetched << endl;
+    } else {
+        out
+            << "# restore a file from the artifact cache" << endl
+            << "rule artifact_restore" << endl
+            << "    description = RESTORE $out" << endl
+#if defined(_WIN32) || defined(__WIN64)
+            << "    command = Powershell Copy-Item -Force -Path $in -Destination $out" << endl
+#else
+            << "    command = cp $in $out" << endl
+#endif
+            << endl
+            ;
+
+        for (const string& file : manifest.at("files")) {
+            Statement restore("artifact_restore");
+
+            restore
+                .appendInput(files + "/" + file)
+                .appendOutput(distdir(file))
+                ;
+
+            out << restore << endl;
+            all.appendInput(distdir(file));
+        }
+    }
+
+    /*
+     * The same names a generated child would have. Applications only phony
+     * their $sourcedir/, which is often the targetName too.
+     */
+
+    if (isApplicationType(type)) {
+        all.appendOutput(sourcedir(""));
+        out << endl << all << endl;
+    } else {
+        all.appendOutput(target);
+        out << endl << all << endl;
+
+        Statement ready("phony");
+        ready
+            .appendInput(target)
+            .appendOutput(headersReady(target))
+            ;
+        out << ready << endl;
+    }
+
+    string artifact = manifest.value("artifact", "");
+    if (!artifact.empty())
+        (*child.artifacts)[target] = child.distdir + "/" + artifact;
+
+    return true;
+}
+
+
+bool package::generatePublish(Bundle& child, const string& key)
+{
+    /*
+     * Whatever the child installs is what a hit restores.
+     */
+
+    list files;
+    if (!installedFiles(child.outputpath, child.distdir, files)) {
+        warning() << "cannot read back " << child.outputpath << "; not publishing it." << endl;
+        return true;
+    }
+
+    string target = child.generator->targetName();
+
+    /*
+     * Nothing to publish, but a shard fetching it still needs its names.
+     */
+    if (files.empty()) {
+        mPublished[child.project.at("project")] = {
+            { "key", key },
+            { "target", target },
+            { "type", child.project.at("type") },
+            { "files", files },
+        };
+        return true;
+    }
+
+    /*
+     * Dependents link with the installed copy of what they'd link with.
+     */
+    string artifact;
+    if (child.artifacts->count(target) > 0) {
+        string linked = filename(child.artifacts->at(target));
+        string stamp = ".interface";
+        if (linked.size() > stamp.size() && linked.compare(linked.size() - stamp.size(), stamp.size(), stamp) == 0)
+            linked.resize(linked.size() - stamp.size());
+        for (const string& file : files) {
+            if (filename(file) == linked)
+                artifact = file;
+        }
+    }
+
+    json metadata = {
+        { "key", key },
+        { "target", target },
+        { "type", child.project.at("type") },
+        { "artifact", artifact },
+        { "files", files },
+        { "distdir", child.distdir },
+    };
+
+    mPublished[child.project.at("project")] = metadata;
+
+    std::ofstream out(child.outputpath, std::ios::app);
+
+    out
+        << endl
+        << "# publish the installed files to the artifact cache" << endl
+        << "rule artifact_publish" << endl
+        << "    description = PUBLISH $out" << endl
+        << "    rspfile = $out.rsp" << endl
+        << "    rspfile_content = $metadata" << endl
+        << "    command = " << bundle().self << " --artifact-publish " << bundle().artifactCache << " $out.rsp $out" << endl
+        << endl
+        ;
+
+    /*
+     * The metadata goes in the response file, so there's nothing in
+     * $builddir that only generating makes. Ninja hashes it with the
+     * command, so a new key publishes again.
+     */
+    string escaped;
+    for (char c : metadata.dump()) {
+        if (c == '$')
+            escaped += '$';
+        escaped += c;
+    }
+
+    Statement publish("artifact_publish");
+
+    publish
+        .appendOutput(builddir("artifact.published"))
+        .appendVariable("metadata", escaped)
+        ;
+    for (const string& file : files)
+        publish.appendDependency(this->distdir(file));
+
+    out << publish << endl;
+
+    return static_cast<bool>(out);
+}
+
+
+
+package::string package::shardDir(long shard) const
+{
+    return bundle().builddir + "/shard-" + std::to_string(shard);
+}
+
+
+bool package::generateShards(const json& project, const list& children)
+{
+    long shards = bundle().shards;
+    list order = generationOrder(children);
+
+    /*
+     * Dependencies name projects, and children are directories.
+     */
+    std::map<string, string> byName;
+    std::map<string, json> projects;
+
+    for (const string& child : children) {
+        projects[child] = childProject(child);
+        if (has(projects[child], "project"))
+            byName[projects[child].at("project")] = child;
+    }
+
+    auto dependencies = [&](const string& child) {
+        list r;
+        if (has(projects[child], "dependencies")) {
+            for (const string& name : projects[child].at("dependencies")) {
+                auto it = byName.find(name);
+                r.push_back(it == byName.cend() ? string() : it->second);
+            }
+        }
+        return r;
+    };
+
+    /*
+     * What artifactKey() can key, decided up front: applications and
+     * libraries whose dependencies are in the package and keyed too.
+     */
+    std::map<string, bool> cacheable;
+
+    for (const string& child : order) {
+        string type = has(projects[child], "type") ? projects[child].at("type").get<string>() : "";
+        bool keyed = isApplicationType(type) || isLibraryType(type);
+
+        for (const string& dependency : dependencies(child))
+            keyed = keyed && !dependency.empty() && cacheable[dependency];
+
+        cacheable[child] = keyed;
+    }
+
+    /*
+     * Weigh each child by its time in the last build of whichever shard it
+     * was in, or an unsharded one. Without any, by how many sources it has.
+     */
+    std::vector<NinjaLog> logs(shards);
+    for (long shard=0; shard < shards; ++shard) {
+        string path = defaultNinjaLog(shardDir(shard));
+        if (std::ifstream(path))
+            logs[shard].load(path);
+    }
+
+    std::map<string, long> weights;
+    long known = 0;
+    long total = 0;
+
+    for (const string& child : children) {
+        long weight = 0;
+
+        for (long shard=0; shard < shards; ++shard)
+            weight = std::max(weight, logs[shard].totalDuration(lexically_normal(shardDir(shard) + "/" + child) + "/"));
+        if (bundle().history)
+            weight = std::max(weight, bundle().history->totalDuration(lexically_normal(bundle().builddir + "/" + child) + "/"));
+
+        weights[child] = weight;
+        if (weight > 0) {
+            ++known;
+            total += weight;
+        }
+    }
+
+    for (const string& child : children) {
+        if (known == 0)
+            weights[child] = has(projects[child], "sources") ? std::max<long>(1, projects[child].at("sources").size()) : 1;
+        else if (weights[child] == 0)
+            weights[child] = total / known;
+    }
+
+    /*
+     * Least loaded first, but never below a dependency's shard: then a shard
+     * only waits on lower numbered ones, and they never wait on it.
+     */
+    std::map<string, long> shardOf;
+    std::vector<long> load(shards, 0);
+
+    for (const string& child : order) {
+        if (!cacheable[child]) {
+            shardOf[child] = shards - 1;
+            load[shards - 1] += weights[child];
+        }
+    }
+
+    for (const string& child : order) {
+        if (!cacheable[child])
+            continue;
+
+        long first = 0;
+        for (const string& dependency : dependencies(child))
+            first = std::max(first, shardOf[dependency]);
+
+        long best = first;
+        for (long shard=first; shard < shards; ++shard) {
+            if (load[shard] < load[best])
+                best = shard;
+        }
+
+        shardOf[child] = best;
+        load[best] += weights[child];
+
+        if (debug())
+            log() << "shard " << best << ": " << child << " weighing " << weights[child] << endl;
+    }
+
+    /*
+     * Generate in dependency order, after fetching whatever a child needs
+     * from other shards into its own.
+     */
+
+    mShardArtifacts.clear();
+    for (long shard=0; shard < shards; ++shard)
+        mShardArtifacts.push_back(std::make_shared<std::map<string, string>>());
+
+    std::vector<list> subninjas(shards);
+    std::vector<std::set<string>> fetched(shards);
+
+    std::function<void(const string&, std::set<string>&)> closure = [&](const string& child, std::set<string>& r) {
+        for (const string& dependency : dependencies(child)) {
+            if (!dependency.empty() && r.insert(dependency).second)
+                closure(dependency, r);
+        }
+    };
+
+    for (const string& child : order) {
+        long shard = shardOf[child];
+
+        std::set<string> needs;
+        closure(child, needs);
+
+        for (const string& dependency : needs) {
+            if (shardOf[dependency] == shard || !fetched[shard].insert(dependency).second)
+                continue;
+
+            string builddir = shardDir(shard) + "/" + dependency;
+            if (!generateFetchedChild(dependency, builddir, shardDir(shard) + "/dist", mShardArtifacts[shard]))
+                return false;
+            subninjas[shard].push_back(builddir + "/build.ninja");
+        }
+
+        generateChildProject(child, shard);
+    }
+
+    for (const string& child : children)
+        subninjas[shardOf[child]].push_back(bundle().sourcedir + "/" + child + "/build.ninja");
+
+    for (long shard=0; shard < shards; ++shard) {
+        string path = (std::filesystem::path(bundle().outputpath).parent_path() / ("shard-" + std::to_string(shard) + ".ninja")).string();
+        std::ofstream out(path);
+
+        out
+            << "# Generated by ngen: shard " << shard << " of " << shards << ", for ninja -f " << path << endl
+            << endl
+            ;
+
+        writePools(out, project);
+
+        out
+            << "# where the shard's .ninja_log goes." << endl
+            << "builddir = " << shardDir(shard) << endl
+            << endl
+            ;
+
+        for (const string& subninja : subninjas[shard])
+            out << "subninja " << subninja << endl;
+
+        if (!out) {
+            error() << "cannot write " << path << endl;
+            return false;
+        }
+
+        out.close();
+        if (!writeDefault(path))
+            return false;
+    }
+
+    /*
+     * Our own output is the merge: what every shard published, fetched into
+     * distdir. The last shard's distdir has what couldn't be published, so
+     * it runs where that shard did, once they're all done.
+     */
+
+    output() << "# assemble distdir from the shards; run after all " << shards << " of them." << endl;
+
+    for (const string& child : order) {
+        if (cacheable[child]) {
+            string builddir = bundle().builddir + "/merge/" + child;
+
+            if (!generateFetchedChild(child, builddir, bundle().distdir, bundle().artifacts))
+                return false;
+            output() << "subninja " << builddir << "/build.ninja" << endl;
+            continue;
+        }
+
+        list files;
+        string last = shardDir(shards - 1) + "/dist";
+        installedFiles(bundle().sourcedir + "/" + child + "/build.ninja", last, files);
+
+        for (const string& file : files) {
+            Statement copy("copy");
+
+            copy
+                .appendInput(last + "/" + file)
+                .appendOutput(distdir(file))
+                ;
+
+            output() << copy << endl;
+        }
+    }
+
+    return true;
 }
 
+
+bool package::generateFetchedChild(const string& name, const string& builddir, const string& distdir,
+                                   std::shared_ptr<std::map<string, string>> artifacts)
+{
+    json project = childProject(name);
+    string projectName = has(project, "project") ? project.at("project").get<string>() : name;
+
+    auto key = bundle().artifactKeys->find(projectName);
+    auto published = mPublished.find(projectName);
+
+    if (key == bundle().artifactKeys->cend() || published == mPublished.cend()) {
+        warning() << name << " has nothing published to fetch." << endl;
+        return true;
+    }
+
+    Bundle child;
+
+    child.debug = bundle().debug;
+    child.argv = bundle().argv;
+    child.sourcedir = bundle().sourcedir + "/" + name;
+    child.builddir = builddir;
+    child.distdir = distdir;
+    child.project = project;
+    child.outputpath = builddir + "/build.ninja";
+    child.artifacts = artifacts;
+
+    std::error_code ec;
+    std::filesystem::create_directories(builddir, ec);
+
+    return generateRestoredChild(child, key->second, published->second, true);
+}
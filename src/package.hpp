@@ -18,6 +18,10 @@
 
 #include "Shinobi.hpp"
 
+#include <map>
+#include <memory>
+#include <vector>
+
 /* Ninja generator - package backend.
  */
 class package : public Shinobi
@@ -33,9 +37,71 @@ class package : public Shinobi
 
   protected:
 
-    bool generateChildProject(const string& name);
+    /** Generate child name's build.ninja.
+     *
+     * @param shard the shard it's built in, or < 0 when not sharding.
+     */
+    bool generateChildProject(const string& name, long shard = -1);
+
+    /** Returns the project in child's ngen.json, or null.
+     */
+    json childProject(const string& child) const;
+
+    /** Returns children in the order to generate them: dependencies first,
+     * otherwise as given.
+     */
+    list generationOrder(const list& children) const;
+
+    /** Split children into bundle().shards shard-K.ninja, and make our own
+     * output assemble distdir from what they publish.
+     *
+     * Each child is built by one shard, in its own builddir and distdir
+     * under shardDir(). What it needs from other shards is fetched from the
+     * artifact cache, so shards only wait on lower numbered ones. Children
+     * that can't be cached go in the last shard, with what depends on them.
+     */
+    bool generateShards(const json& project, const list& children);
+
+    /** Returns where shard puts its builddirs, distdir, and .ninja_log.
+     */
+    string shardDir(long shard) const;
+
+    /** Returns the artifact cache key for child, or "" if it can't be cached.
+     *
+     * That's a SHA-256 of its sources, its toolchain, the settings handed down
+     * to it, and the keys of its dependencies. Only C/C++ and Java
+     * applications and libraries can be cached, and only when what they
+     * depend on can be.
+     */
+    string artifactKey(const Bundle& child) const;
+
+    /** Write child's build.ninja to restore its installed files from the
+     * artifact cache instead of building them.
+     *
+     * @param fetch wait for another build to publish them, if it hasn't.
+     */
+    bool generateRestoredChild(Bundle& child, const string& key, const json& manifest, bool fetch = false);
+
+    /** Write a build.ninja in builddir that stands in for child name: it
+     * fetches what name published into distdir, waiting for it if needed.
+     */
+    bool generateFetchedChild(const string& name, const string& builddir, const string& distdir,
+                              std::shared_ptr<std::map<string, string>> artifacts);
+
+    /** Add an edge to child's build.ninja that publishes its installed files
+     * to the artifact cache under key, once they're built.
+     */
+    bool generatePublish(Bundle& child, const string& key);
 
   private:
+
+    /** Child projects' artifact metadata, by project name.
+     */
+    std::map<string, json> mPublished;
+
+    /** What dependents link with in each shard, like Bundle::artifacts.
+     */
+    std::vector<std::shared_ptr<std::map<string, string>>> mShardArtifacts;
 };
 
 #endif // NGEN_PACKAGE__HPP
@@ -20,6 +20,8 @@
  */
 #include "filesystem.hpp"
 
+#include <vector>
+
 using std::string;
 
 string filename(const string& path)
@@ -64,3 +66,35 @@ string replace_extension(const string& path, const string& new_extension)
 #endif
 }
 
+string lexically_normal(const string& path)
+{
+    std::vector<string> parts;
+    bool absolute = !path.empty() && path[0] == '/';
+    size_t start = 0;
+
+    while (start <= path.size()) {
+        size_t slash = path.find_first_of("/\\", start);
+        if (slash == string::npos)
+            slash = path.size();
+
+        string part = path.substr(start, slash - start);
+        start = slash + 1;
+
+        if (part.empty() || part == ".")
+            continue;
+
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else
+            parts.push_back(part);
+    }
+
+    string r = absolute ? "/" : "";
+    for (size_t i=0; i < parts.size(); ++i) {
+        if (i > 0)
+            r.push_back('/');
+        r.append(parts[i]);
+    }
+
+    return r.empty() ? "." : r;
+}
@@ -29,4 +29,11 @@ std::string filename(const std::string& path);
 std::string extension(const std::string& path);
 std::string replace_extension(const std::string& path, const std::string& new_extension);
 
+/** Returns path with "." and "dir/.." components removed, like ninja does.
+ *
+ * This is what ninja records in its log, so paths we generate need to go
+ * through here before they can be compared.
+ */
+std::string lexically_normal(const std::string& path);
+
 #endif // NGEN_PATH__HPP
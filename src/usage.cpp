@@ -0,0 +1,435 @@
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "usage.hpp"
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_WIN32)
+extern "C" {
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+#endif
+
+using std::endl;
+using std::string;
+
+UsageLog::UsageLog()
+    : mLatest()
+    , mLines(0)
+{
+}
+
+
+bool UsageLog::load(const string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::clog << "cannot open usage log: " << path << endl;
+        return false;
+    }
+
+    mLatest.clear();
+    mLines = 0;
+
+    /*
+     * status, wall ms, user ms, sys ms, peak KiB, bytes read, bytes written,
+     * project, output; tab separated.
+     */
+    string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        string status, wall, user, sys, peak, read, written, project, output;
+
+        if (!std::getline(fields, status, '\t')
+            || !std::getline(fields, wall, '\t')
+            || !std::getline(fields, user, '\t')
+            || !std::getline(fields, sys, '\t')
+            || !std::getline(fields, peak, '\t')
+            || !std::getline(fields, read, '\t')
+            || !std::getline(fields, written, '\t')
+            || !std::getline(fields, project, '\t')
+            || !std::getline(fields, output)
+            || output.empty())
+        {
+            continue;
+        }
+
+        Entry& entry = mLatest[output];
+        entry.status = std::atoi(status.c_str());
+        entry.wallMs = std::strtol(wall.c_str(), nullptr, 10);
+        entry.userMs = std::strtol(user.c_str(), nullptr, 10);
+        entry.sysMs = std::strtol(sys.c_str(), nullptr, 10);
+        entry.peakBytes = std::strtoull(peak.c_str(), nullptr, 10) * 1024;
+        entry.readBytes = std::strtoull(read.c_str(), nullptr, 10);
+        entry.writtenBytes = std::strtoull(written.c_str(), nullptr, 10);
+        entry.project = project;
+        ++mLines;
+    }
+
+    return true;
+}
+
+
+const UsageLog::Entry* UsageLog::find(const string& output) const
+{
+    auto it = mLatest.find(output);
+
+    if (it == mLatest.cend())
+        return nullptr;
+
+    return &it->second;
+}
+
+
+const std::map<string, UsageLog::Entry>& UsageLog::entries() const
+{
+    return mLatest;
+}
+
+
+/*
+ * One line of the log, newline and all.
+ */
+static string usageLine(const UsageLog::Entry& entry, const string& output)
+{
+    return std::to_string(entry.status)
+        + "\t" + std::to_string(entry.wallMs)
+        + "\t" + std::to_string(entry.userMs)
+        + "\t" + std::to_string(entry.sysMs)
+        + "\t" + std::to_string(entry.peakBytes / 1024)
+        + "\t" + std::to_string(entry.readBytes)
+        + "\t" + std::to_string(entry.writtenBytes)
+        + "\t" + entry.project
+        + "\t" + output
+        + "\n";
+}
+
+
+bool UsageLog::compact(const string& path) const
+{
+    if (mLines < 1000 || mLines < 4 * mLatest.size())
+        return true;
+
+    string tmp = temporaryName(path);
+    std::ofstream out(tmp);
+
+    for (const auto& pair : mLatest)
+        out << usageLine(pair.second, pair.first);
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::clog << "cannot compact usage log: " << path << endl;
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+bool UsageLog::empty() const
+{
+    return mLatest.empty();
+}
+
+
+string defaultUsageLog(const string& builddir)
+{
+    if (builddir.empty())
+        return ".ngen_usage";
+
+    return builddir + "/.ngen_usage";
+}
+
+
+#if defined(__linux__)
+/*
+ * Bytes pid and the children it waited for read and wrote. Only there
+ * until pid is reaped.
+ */
+static void procIoBytes(pid_t pid, UsageLog::Entry& entry)
+{
+    std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+    string key;
+    uintmax_t value;
+
+    while (io >> key >> value) {
+        if (key == "rchar:")
+            entry.readBytes = value;
+        else if (key == "wchar:")
+            entry.writtenBytes = value;
+    }
+}
+#endif
+
+
+int measureCommand(const string& log, const string& project, const string& output, const std::vector<string>& command)
+{
+    if (command.empty())
+        return 1;
+
+#if defined(_WIN32)
+    (void)log;
+    (void)project;
+    (void)output;
+    return runCommand(command);
+#else
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        std::clog << "cannot run " << command.front() << ": " << std::strerror(errno) << endl;
+        return 1;
+    }
+
+    if (pid == 0) {
+        size_t i = 0;
+        for (; i < command.size(); ++i) {
+            size_t equals = command[i].find('=');
+            if (equals == string::npos || equals == 0 || command[i].find('/') < equals)
+                break;
+            setenv(command[i].substr(0, equals).c_str(), command[i].c_str() + equals + 1, 1);
+        }
+
+        std::vector<char*> argv;
+        for (; i < command.size(); ++i)
+            argv.push_back(const_cast<char*>(command[i].c_str()));
+        argv.push_back(nullptr);
+
+        if (argv.front() != nullptr)
+            execvp(argv.front(), argv.data());
+        std::clog << "cannot run " << command.back() << ": " << std::strerror(errno) << endl;
+        _exit(127);
+    }
+
+    /*
+     * Wait without reaping first, so the zombie's I/O can still be read.
+     * wait4 then gives the peak of the command and the children it waited
+     * for: the compiler proper, not just the driver.
+     */
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR)
+        ;
+    long wall = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count());
+
+    UsageLog::Entry entry = {};
+#if defined(__linux__)
+    procIoBytes(pid, entry);
+#endif
+
+    int status = 0;
+    struct rusage usage;
+
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            std::clog << "cannot wait for " << command.front() << ": " << std::strerror(errno) << endl;
+            return 1;
+        }
+    }
+
+    if (WIFEXITED(status))
+        entry.status = WEXITSTATUS(status);
+    else
+        entry.status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 1;
+
+    entry.wallMs = wall;
+    entry.userMs = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+    entry.sysMs = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+    entry.project = project;
+
+    /* Bytes on macOS, KiB everywhere else. */
+    entry.peakBytes = static_cast<uintmax_t>(usage.ru_maxrss);
+#if !defined(__APPLE__)
+    entry.peakBytes *= 1024;
+#endif
+
+    /* Elsewhere, there's only blocks of real I/O. */
+#if !defined(__linux__)
+    entry.readBytes = static_cast<uintmax_t>(usage.ru_inblock) * 512;
+    entry.writtenBytes = static_cast<uintmax_t>(usage.ru_oublock) * 512;
+#endif
+
+    /*
+     * One short write with O_APPEND, so parallel edges don't interleave.
+     */
+    string line = usageLine(entry, output);
+    int fd = open(log.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0 || write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+        std::clog << "cannot record usage in " << log << ": " << std::strerror(errno) << endl;
+    if (fd >= 0)
+        close(fd);
+
+    return entry.status;
+#endif
+}
+
+
+/*
+ * Quote an OpenMetrics label value.
+ */
+static string labelQuote(const string& s)
+{
+    string r = "\"";
+
+    for (char c : s) {
+        if (c == '\n') {
+            r += "\\n";
+            continue;
+        }
+        if (c == '"' || c == '\\')
+            r.push_back('\\');
+        r.push_back(c);
+    }
+
+    return r + "\"";
+}
+
+
+bool summarizeUsage(std::ostream& out, const string& log, const string& metrics)
+{
+    UsageLog usage;
+    if (!usage.load(log))
+        return false;
+
+    struct Rollup
+    {
+        size_t edges = 0;
+        size_t failed = 0;
+        long wallMs = 0;
+        long cpuMs = 0;
+        uintmax_t peakBytes = 0;
+        uintmax_t readBytes = 0;
+        uintmax_t writtenBytes = 0;
+    };
+    std::map<string, Rollup> projects;
+
+    for (const auto& pair : usage.entries()) {
+        const UsageLog::Entry& entry = pair.second;
+        Rollup& rollup = projects[entry.project];
+
+        rollup.edges++;
+        if (entry.status != 0)
+            rollup.failed++;
+        rollup.wallMs += entry.wallMs;
+        rollup.cpuMs += entry.cpuMs();
+        rollup.peakBytes = std::max(rollup.peakBytes, entry.peakBytes);
+        rollup.readBytes += entry.readBytes;
+        rollup.writtenBytes += entry.writtenBytes;
+    }
+
+    static const uintmax_t mib = 1024 * 1024;
+
+    out << std::left << std::setw(32) << "project"
+        << std::right << std::setw(8) << "edges" << std::setw(8) << "failed"
+        << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms" << std::setw(12) << "peak MiB"
+        << std::setw(12) << "read MiB" << std::setw(12) << "write MiB" << endl;
+    for (const auto& pair : projects) {
+        const Rollup& rollup = pair.second;
+        out << std::left << std::setw(32) << pair.first
+            << std::right << std::setw(8) << rollup.edges << std::setw(8) << rollup.failed
+            << std::setw(12) << rollup.wallMs << std::setw(12) << rollup.cpuMs
+            << std::setw(12) << rollup.peakBytes / mib
+            << std::setw(12) << rollup.readBytes / mib << std::setw(12) << rollup.writtenBytes / mib << endl;
+    }
+
+    /*
+     * Gauges, since each is the last run of an edge rather than a running
+     * total. Per edge, then rolled up per project.
+     */
+    string tmp = temporaryName(metrics);
+    std::ofstream om(tmp);
+    om << std::fixed << std::setprecision(3);
+
+    auto family = [&om](const string& name, const string& unit, const string& help) {
+        om << "# TYPE " << name << " gauge" << endl;
+        if (!unit.empty())
+            om << "# UNIT " << name << " " << unit << endl;
+        om << "# HELP " << name << " " << help << endl;
+    };
+
+    auto edges = [&om, &usage](const string& name, auto value) {
+        for (const auto& pair : usage.entries()) {
+            om << name << "{project=" << labelQuote(pair.second.project)
+                << ",output=" << labelQuote(pair.first) << "} " << value(pair.second) << endl;
+        }
+    };
+
+    auto rollups = [&om, &projects](const string& name, auto value) {
+        for (const auto& pair : projects)
+            om << name << "{project=" << labelQuote(pair.first) << "} " << value(pair.second) << endl;
+    };
+
+    using Entry = UsageLog::Entry;
+
+    family("ngen_edge_exit_status", "", "Exit status of the edge's last run.");
+    edges("ngen_edge_exit_status", [](const Entry& e) { return e.status; });
+    family("ngen_edge_wall_seconds", "seconds", "Wall time of the edge's last run.");
+    edges("ngen_edge_wall_seconds", [](const Entry& e) { return e.wallMs / 1000.0; });
+    family("ngen_edge_user_seconds", "seconds", "User CPU time of the edge's last run.");
+    edges("ngen_edge_user_seconds", [](const Entry& e) { return e.userMs / 1000.0; });
+    family("ngen_edge_system_seconds", "seconds", "System CPU time of the edge's last run.");
+    edges("ngen_edge_system_seconds", [](const Entry& e) { return e.sysMs / 1000.0; });
+    family("ngen_edge_peak_rss_bytes", "bytes", "Peak resident set size of the edge's last run.");
+    edges("ngen_edge_peak_rss_bytes", [](const Entry& e) { return e.peakBytes; });
+    family("ngen_edge_read_bytes", "bytes", "Bytes the edge's last run read.");
+    edges("ngen_edge_read_bytes", [](const Entry& e) { return e.readBytes; });
+    family("ngen_edge_written_bytes", "bytes", "Bytes the edge's last run wrote.");
+    edges("ngen_edge_written_bytes", [](const Entry& e) { return e.writtenBytes; });
+
+    family("ngen_project_edges", "", "Edges of the project that were measured.");
+    rollups("ngen_project_edges", [](const Rollup& r) { return r.edges; });
+    family("ngen_project_failed_edges", "", "Edges of the project whose last run failed.");
+    rollups("ngen_project_failed_edges", [](const Rollup& r) { return r.failed; });
+    family("ngen_project_wall_seconds", "seconds", "Sum of the wall time of the project's edges.");
+    rollups("ngen_project_wall_seconds", [](const Rollup& r) { return r.wallMs / 1000.0; });
+    family("ngen_project_cpu_seconds", "seconds", "Sum of the CPU time of the project's edges.");
+    rollups("ngen_project_cpu_seconds", [](const Rollup& r) { return r.cpuMs / 1000.0; });
+    family("ngen_project_peak_rss_bytes", "bytes", "Largest peak resident set size of the project's edges.");
+    rollups("ngen_project_peak_rss_bytes", [](const Rollup& r) { return r.peakBytes; });
+    family("ngen_project_read_bytes", "bytes", "Sum of the bytes the project's edges read.");
+    rollups("ngen_project_read_bytes", [](const Rollup& r) { return r.readBytes; });
+    family("ngen_project_written_bytes", "bytes", "Sum of the bytes the project's edges wrote.");
+    rollups("ngen_project_written_bytes", [](const Rollup& r) { return r.writtenBytes; });
+
+    om << "# EOF" << endl;
+    om.close();
+
+    if (!om || std::rename(tmp.c_str(), metrics.c_str()) != 0) {
+        std::clog << "cannot write " << metrics << endl;
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef NGEN_USAGE__HPP
+#define NGEN_USAGE__HPP
+/*
+ * Copyright 2019-current Terry Mathew Poulin <BigBoss1964@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Reader for what ngen --measure records about each edge.
+ *
+ * Every measured edge appends a line, so the log holds several builds.
+ * The most recent entry for an output is the one that counts.
+ */
+class UsageLog
+{
+  public:
+    using string = std::string;
+
+    /** What one run of an edge took.
+     */
+    struct Entry
+    {
+        /** Exit status; 128 + the signal if one killed it. */
+        int status;
+        long wallMs;
+        long userMs;
+        long sysMs;
+        /** Peak resident set size of the command and its children. */
+        uintmax_t peakBytes;
+        /** Bytes read and written through read() and write() and the like. */
+        uintmax_t readBytes;
+        uintmax_t writtenBytes;
+        /** The project whose build.ninja has the edge. */
+        string project;
+
+        long cpuMs() const { return userMs + sysMs; }
+    };
+
+    UsageLog();
+
+    /** Load path.
+     *
+     * @returns false on failure, with a message on std::clog.
+     */
+    bool load(const string& path);
+
+    /** Returns the most recent entry for output, or nullptr.
+     */
+    const Entry* find(const string& output) const;
+
+    /** Returns the most recent entry for every output.
+     */
+    const std::map<string, Entry>& entries() const;
+
+    /** Rewrite path with only the most recent entries, if it has grown to
+     * mostly old ones.
+     *
+     * @returns false on failure, with a message on std::clog.
+     */
+    bool compact(const string& path) const;
+
+    bool empty() const;
+
+  private:
+    std::map<string, Entry> mLatest;
+    size_t mLines;
+};
+
+/** Returns where the usage log for a builddir goes.
+ *
+ * Next to .ninja_log, in the top level $builddir.
+ */
+std::string defaultUsageLog(const std::string& builddir);
+
+/** Run command, and append what it took to make output to log.
+ *
+ * Leading NAME=VALUE arguments are set in its environment, as the shell
+ * would. Each record is a single append, so edges running in parallel can
+ * share the log without locking it.
+ *
+ * @returns the exit status of command.
+ */
+int measureCommand(const std::string& log, const std::string& project, const std::string& output, const std::vector<std::string>& command);
+
+/** Summarize log: a table per project to out, and every edge and project as
+ * OpenMetrics to metrics.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool summarizeUsage(std::ostream& out, const std::string& log, const std::string& metrics);
+
+#endif // NGEN_USAGE__HPP
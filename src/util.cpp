@@ -26,8 +26,18 @@
 #include "msvc.hpp"
 #include "package.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+
 extern "C" {
 #if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 #include <direct.h>
 #ifndef chdir
 #define chdir _chdir
@@ -38,6 +48,7 @@ extern "C" {
 #else
 #include <unistd.h>
 #include <sys/param.h>
+#include <sys/wait.h>
 #endif
 }
 
@@ -128,6 +139,233 @@ vector<string> ls(const string& path, bool recurse)
 }
 
 
+uintmax_t fileSize(const string& path)
+{
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+
+    return ec ? 0 : size;
+}
+
+
+uintmax_t physicalMemory()
+{
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+
+    if (!GlobalMemoryStatusEx(&status))
+        return 0;
+
+    return status.ullTotalPhys;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long size = sysconf(_SC_PAGE_SIZE);
+
+    if (pages < 0 || size < 0)
+        return 0;
+
+    return static_cast<uintmax_t>(pages) * static_cast<uintmax_t>(size);
+#endif
+}
+
+
+string toolIdentity(const string& tool)
+{
+    namespace fs = std::filesystem;
+
+    fs::path path = tool;
+    std::error_code ec;
+
+#if defined(_WIN32)
+    const char separator = ';';
+#else
+    const char separator = ':';
+#endif
+
+    if (tool.find_first_of("/\\") == string::npos) {
+        const char* env = std::getenv("PATH");
+        std::istringstream dirs(env == nullptr ? "" : env);
+        string dir;
+
+        while (std::getline(dirs, dir, separator)) {
+            fs::path candidate = fs::path(dir.empty() ? "." : dir) / tool;
+            if (fs::exists(candidate, ec)) {
+                path = candidate;
+                break;
+            }
+        }
+    }
+
+    fs::path canonical = fs::canonical(path, ec);
+    if (ec)
+        return tool;
+
+    auto time = fs::last_write_time(canonical, ec).time_since_epoch().count();
+
+    return canonical.string() + ":" + to_string(fs::file_size(canonical, ec)) + ":" + to_string(time);
+}
+
+
+/*
+ * For /bin/sh, which is what std::system() runs.
+ */
+static string quote(const string& arg)
+{
+    string r = "'";
+
+    for (char c : arg) {
+        if (c == '\'')
+            r += "'\\''";
+        else
+            r.push_back(c);
+    }
+
+    return r + "'";
+}
+
+
+int runCommand(const vector<string>& argv)
+{
+    string command;
+
+    for (const string& arg : argv) {
+        if (!command.empty())
+            command.push_back(' ');
+        command += quote(arg);
+    }
+
+    int status = std::system(command.c_str());
+
+#if defined(_WIN32)
+    return status;
+#else
+    if (status == -1)
+        return 1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+#endif
+}
+
+
+string readFile(const string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream content;
+
+    content << in.rdbuf();
+
+    return content.str();
+}
+
+
+string temporaryName(const string& prefix)
+{
+    static std::random_device device;
+    static std::mt19937_64 random(device());
+
+    return prefix + "." + hex(random()) + ".tmp";
+}
+
+
+bool replaceIfChanged(const string& from, const string& to)
+{
+    std::error_code ec;
+
+    /*
+     * Sizes first, it's the common case for a real change and saves reading.
+     */
+    if (std::filesystem::exists(to, ec) && fileSize(from) == fileSize(to)) {
+        std::ifstream a(from, std::ios::binary);
+        std::ifstream b(to, std::ios::binary);
+
+        bool same = a && b
+            && std::equal(std::istreambuf_iterator<char>(a), std::istreambuf_iterator<char>(),
+                          std::istreambuf_iterator<char>(b), std::istreambuf_iterator<char>());
+        a.close();
+        b.close();
+
+        if (same) {
+            std::filesystem::remove(from, ec);
+            return true;
+        }
+    }
+
+    std::filesystem::rename(from, to, ec);
+    if (ec) {
+        std::clog << "cannot rename " << from << " to " << to << ": " << ec.message() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool includeFile(const string& output, const std::vector<string>& files)
+{
+    namespace fs = std::filesystem;
+
+    fs::path dir = fs::absolute(output).parent_path().lexically_normal();
+    string content = "/* Generated by ngen. Do not edit. */\n";
+
+    for (const string& file : files) {
+        fs::path path = fs::absolute(file).lexically_normal();
+        fs::path rel = path.lexically_relative(dir);
+        if (rel.empty())
+            rel = path;
+        content += "#include \"" + rel.generic_string() + "\"\n";
+    }
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    string tmp = temporaryName(output);
+    std::ofstream out(tmp, std::ios::binary);
+    out << content;
+    out.close();
+    if (!out) {
+        std::clog << "cannot write " << tmp << endl;
+        fs::remove(tmp, ec);
+        return false;
+    }
+
+    return replaceIfChanged(tmp, output);
+}
+
+
+bool globMatch(const string& pattern, const string& path)
+{
+    size_t p = 0;
+    size_t s = 0;
+
+    while (p < pattern.size()) {
+        if (pattern.compare(p, 2, "**") == 0) {
+            for (size_t rest = s; rest <= path.size(); ++rest) {
+                if (globMatch(pattern.substr(p + 2), path.substr(rest)))
+                    return true;
+            }
+            return false;
+        }
+        if (pattern[p] == '*') {
+            for (size_t rest = s; rest <= path.size(); ++rest) {
+                if (globMatch(pattern.substr(p + 1), path.substr(rest)))
+                    return true;
+                if (rest < path.size() && path[rest] == '/')
+                    break;
+            }
+            return false;
+        }
+        if (s == path.size())
+            return false;
+        if (pattern[p] == '?' ? path[s] == '/' : pattern[p] != path[s])
+            return false;
+        ++p;
+        ++s;
+    }
+
+    return s == path.size();
+}
+
+
 int parse(Bundle& b)
 {
     if (b.debug)
@@ -278,3 +516,117 @@ json sortedDistributionKeys()
 }
 
 
+uint64_t fnv1a(const string& data, uint64_t basis)
+{
+    uint64_t hash = basis;
+
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+
+string hex(uint64_t value)
+{
+    static const char* digits = "0123456789abcdef";
+
+    string r(16, '0');
+    for (int i=15; i >= 0; --i) {
+        r[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+
+    return r;
+}
+
+
+string sha256(const string& data)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    uint32_t h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    auto compress = [&](const char* block) {
+        uint32_t w[64];
+
+        for (int i=0; i < 16; ++i) {
+            w[i] = 0;
+            for (int j=0; j < 4; ++j)
+                w[i] = (w[i] << 8) | static_cast<unsigned char>(block[i * 4 + j]);
+        }
+        for (int i=16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+
+        for (int i=0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = hh + s1 + ch + k[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    };
+
+    size_t whole = data.size() / 64 * 64;
+    for (size_t block=0; block < whole; block += 64)
+        compress(data.data() + block);
+
+    /*
+     * The rest, a 1 bit, zeros to 56 mod 64 bytes, then the length in bits.
+     */
+    string tail = data.substr(whole);
+    uint64_t bits = uint64_t(data.size()) * 8;
+    tail += '\x80';
+    while (tail.size() % 64 != 56)
+        tail += '\0';
+    for (int i=7; i >= 0; --i)
+        tail += static_cast<char>((bits >> (i * 8)) & 0xff);
+
+    for (size_t block=0; block < tail.size(); block += 64)
+        compress(tail.data() + block);
+
+    string r;
+    for (int i=0; i < 8; i += 2)
+        r += hex((uint64_t(h[i]) << 32) | h[i + 1]);
+
+    return r;
+}
@@ -22,6 +22,7 @@
 
 #include "Shinobi.hpp"
 
+#include <cstdint>
 #include <string>
 #include <nlohmann/json.hpp>
 #include <vector>
@@ -57,6 +58,61 @@ bool cd(const std::string& where);
  */
 std::vector<std::string> ls(const std::string& path, bool recurse);
 
+/** Returns the size of a file in bytes, or 0 if it cannot be found.
+ */
+uintmax_t fileSize(const std::string& path);
+
+/** Returns the bytes of RAM in the machine, or 0 if it cannot be found.
+ */
+uintmax_t physicalMemory();
+
+/** Returns the path, size, and time of tool, searching $PATH for it.
+ *
+ * Cheaper than running it for a --version, and changes when it is upgraded.
+ * Just tool if it can't be found.
+ */
+std::string toolIdentity(const std::string& tool);
+
+/** Run argv through the shell, each argument quoted.
+ *
+ * @returns its exit status, or 1 if it didn't exit normally.
+ */
+int runCommand(const std::vector<std::string>& argv);
+
+/** Returns the content of path, or an empty string if it cannot be read.
+ */
+std::string readFile(const std::string& path);
+
+/** Returns prefix plus a random suffix, for writing to the side and renaming.
+ */
+std::string temporaryName(const std::string& prefix);
+
+/** Rename from to to, unless to has the same content.
+ *
+ * Then from is removed, and to keeps its old modification time. That is
+ * what restat looks for.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool replaceIfChanged(const std::string& from, const std::string& to);
+
+/** Write output as a source that #includes each of files, relative to it.
+ *
+ * Unity sources and precompiled header wrappers are made this way from
+ * build.ninja, so they come back after the build directory is removed, and
+ * still work when the trees move together. Only replaced when different.
+ *
+ * @returns false on failure, with a message on std::clog.
+ */
+bool includeFile(const std::string& output, const std::vector<std::string>& files);
+
+/** Returns if path matches pattern.
+ *
+ * * and ? match within a directory, ** matches across them. Anything else
+ * matches itself.
+ */
+bool globMatch(const std::string& pattern, const std::string& path);
+
 /** Handle parsing data into the bundle's fields.
  *
  * @returns < 0 on success; >= 0 on failure.
@@ -82,4 +138,21 @@ nlohmann::json defaultDistribution();
  */
 nlohmann::json sortedDistributionKeys();
 
+/** Returns the 64-bit FNV-1a hash of data.
+ *
+ * Stable across platforms and runs, so it can be saved to disk. A different
+ * basis gives a second hash that doesn't collide where the first does.
+ */
+uint64_t fnv1a(const std::string& data, uint64_t basis = 14695981039346656037ULL);
+
+/** Returns value as 16 lower case hex digits.
+ */
+std::string hex(uint64_t value);
+
+/** Returns the SHA-256 digest of data, as 64 lower case hex digits.
+ *
+ * For cache keys, where a collision would hand back the wrong file.
+ */
+std::string sha256(const std::string& data);
+
 #endif // NGEN_UTIL__HPP
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Build some of the examples with --record-usage, and check every edge ran
+# and was recorded for its own output, and usage-summary reports them.
+#
+# usage: test-record-usage.sh [-n NGEN]
+#
+# NGEN must be an absolute path, or on $PATH. Exits non-zero on failure.
+#
+set -e
+
+ngen=ngen
+
+while getopts n: opt; do
+    case $opt in
+        n) ngen=$OPTARG ;;
+        *) echo "usage: $0 [-n NGEN]" >&2; exit 64 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+examples=$(cd "$(dirname "$0")/examples" && pwd)
+tree=$(mktemp -d)
+trap 'rm -rf "$tree"' EXIT
+
+for project in c_helloworld cxx_library cxx_application; do
+    cp -R "$examples/$project" "$tree/"
+done
+cat >"$tree/ngen.json" <<JSON
+{
+    "project": "examples",
+    "type": "package",
+    "sources": [ "c_helloworld", "cxx_library", "cxx_application" ]
+}
+JSON
+
+fail() {
+    echo "$0: $*" >&2
+    exit 1
+}
+
+$ngen -C "$tree" --record-usage >/dev/null
+ninja -C "$tree" >/dev/null || fail "build with --record-usage failed"
+[ ! -e "$tree/build/usage.om" ] || fail "a plain ninja ran usage-summary"
+
+usage=$tree/build/.ngen_usage
+[ -s "$usage" ] || fail "nothing recorded in $usage"
+
+# status wall user sys peak read written project output
+awk -F '\t' '$1 != 0 { print "failed:", $0; bad = 1 } END { exit bad }' "$usage" \
+    || fail "an edge failed"
+
+# A compile, a link, an install and a copy of each kind.
+outputs="
+    build/cxx_library/src/add.o
+    build/cxx_application/src/main.o
+    build/cxx_library/lib/libcxx_library.so
+    build/cxx_application/bin/cxx_application
+    dist/bin/cxx_application
+    dist/include/cxx_library/add.h
+"
+
+for output in $outputs; do
+    awk -F '\t' -v out="$output" '$9 == out { found = 1 } END { exit !found }' "$usage" \
+        || fail "no record for $output"
+done
+
+ninja -C "$tree" usage-summary >/dev/null || fail "usage-summary failed"
+
+for output in $outputs; do
+    grep -q "^ngen_edge_wall_seconds{project=\"[a-z_]*\",output=\"$output\"}" "$tree/build/usage.om" \
+        || fail "no metrics for $output"
+done
+tail -n 1 "$tree/build/usage.om" | grep -qx '# EOF' || fail "usage.om isn't terminated"